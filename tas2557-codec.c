@@ -27,6 +27,7 @@
 #include <linux/init.h>
 #include <linux/delay.h>
 #include <linux/pm.h>
+#include <linux/pm_runtime.h>
 #include <linux/i2c.h>
 #include <linux/gpio.h>
 #include <linux/regulator/consumer.h>
@@ -57,6 +58,10 @@ static unsigned int tas2557_codec_read(struct snd_soc_codec *pCodec,
 	int ret = 0;
 	unsigned int Value = 0;
 
+	ret = tas2557_pm_get(pTAS2557);
+	if (ret < 0)
+		return ret;
+
 	mutex_lock(&pTAS2557->codec_lock);
 
 	ret = pTAS2557->read(pTAS2557, nRegister, &Value);
@@ -67,6 +72,7 @@ static unsigned int tas2557_codec_read(struct snd_soc_codec *pCodec,
 		ret = Value;
 
 	mutex_unlock(&pTAS2557->codec_lock);
+	tas2557_pm_put(pTAS2557);
 	return ret;
 }
 
@@ -76,11 +82,16 @@ static int tas2557_codec_write(struct snd_soc_codec *pCodec, unsigned int nRegis
 	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(pCodec);
 	int ret = 0;
 
+	ret = tas2557_pm_get(pTAS2557);
+	if (ret < 0)
+		return ret;
+
 	mutex_lock(&pTAS2557->codec_lock);
 
 	ret = pTAS2557->write(pTAS2557, nRegister, nValue);
 
 	mutex_unlock(&pTAS2557->codec_lock);
+	tas2557_pm_put(pTAS2557);
 	return ret;
 }
 
@@ -89,11 +100,19 @@ static int tas2557_codec_suspend(struct snd_soc_codec *pCodec)
 	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(pCodec);
 	int ret = 0;
 
+	tas2557_engine_wait(pTAS2557);
+
 	mutex_lock(&pTAS2557->codec_lock);
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
 
 	dev_dbg(pTAS2557->dev, "%s\n", __func__);
 	pTAS2557->runtime_suspend(pTAS2557);
 
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
 	mutex_unlock(&pTAS2557->codec_lock);
 	return ret;
 }
@@ -104,21 +123,57 @@ static int tas2557_codec_resume(struct snd_soc_codec *pCodec)
 	int ret = 0;
 
 	mutex_lock(&pTAS2557->codec_lock);
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
 
 	dev_dbg(pTAS2557->dev, "%s\n", __func__);
 	pTAS2557->runtime_resume(pTAS2557);
 
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
 	mutex_unlock(&pTAS2557->codec_lock);
 	return ret;
 }
 
+/*
+* Class-D power follows the DAPM path, mute/unmute only touches the
+* mute registers
+*/
+static int tas2557_classd_event(struct snd_soc_dapm_widget *w,
+	struct snd_kcontrol *kcontrol, int event)
+{
+	struct snd_soc_codec *codec = snd_soc_dapm_to_codec(w->dapm);
+	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(codec);
+
+	dev_dbg(pTAS2557->dev, "%s, event 0x%x\n", __func__, event);
+
+	switch (event) {
+	case SND_SOC_DAPM_POST_PMU:
+		/* the stream keeps the device resumed until PRE_PMD */
+		tas2557_pm_get(pTAS2557);
+		/* audio flows after this, wait for the downloads queued so far */
+		tas2557_engine_post_power(pTAS2557, true);
+		tas2557_engine_wait(pTAS2557);
+		break;
+	case SND_SOC_DAPM_PRE_PMD:
+		tas2557_engine_post_power(pTAS2557, false);
+		tas2557_pm_put(pTAS2557);
+		break;
+	}
+
+	return 0;
+}
+
 static const struct snd_soc_dapm_widget tas2557_dapm_widgets[] = {
 	SND_SOC_DAPM_AIF_IN("ASI1", "ASI1 Playback", 0, SND_SOC_NOPM, 0, 0),
 	SND_SOC_DAPM_AIF_IN("ASI2", "ASI2 Playback", 0, SND_SOC_NOPM, 0, 0),
 	SND_SOC_DAPM_AIF_IN("ASIM", "ASIM Playback", 0, SND_SOC_NOPM, 0, 0),
 	SND_SOC_DAPM_DAC("DAC", NULL, SND_SOC_NOPM, 0, 0),
 
-	SND_SOC_DAPM_OUT_DRV("ClassD", SND_SOC_NOPM, 0, 0, NULL, 0),
+	SND_SOC_DAPM_OUT_DRV_E("ClassD", SND_SOC_NOPM, 0, 0, NULL, 0,
+		tas2557_classd_event, SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_PRE_PMD),
 
 	SND_SOC_DAPM_SUPPLY("PLL", SND_SOC_NOPM, 0, 0, NULL, 0),
 	SND_SOC_DAPM_SUPPLY("NDivider", SND_SOC_NOPM, 0, 0, NULL, 0),
@@ -160,12 +215,21 @@ static int tas2557_mute(struct snd_soc_dai *dai, int mute)
 	struct snd_soc_codec *codec = dai->codec;
 	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(codec);
 
-	mutex_lock(&pTAS2557->codec_lock);
+	dev_dbg(pTAS2557->dev, "%s, %d\n", __func__, mute);
 
-	dev_dbg(pTAS2557->dev, "%s\n", __func__);
-	tas2557_enable(pTAS2557, !mute);
+	/* a power up posted by DAPM applies the mute state itself */
+	tas2557_engine_wait(pTAS2557);
 
+	mutex_lock(&pTAS2557->codec_lock);
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+	tas2557_set_mute(pTAS2557, (mute != 0));
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
 	mutex_unlock(&pTAS2557->codec_lock);
+
 	return 0;
 }
 
@@ -186,14 +250,11 @@ static int tas2557_hw_params(struct snd_pcm_substream *pSubstream,
 	struct snd_soc_codec *pCodec = pDAI->codec;
 	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(pCodec);
 
-	mutex_lock(&pTAS2557->codec_lock);
-
 	dev_dbg(pTAS2557->dev, "%s\n", __func__);
 /* do bit rate setting during platform data */
 /* tas2557_set_bit_rate(pTAS2557, channel_both, snd_pcm_format_width(params_format(pParams))); */
-	tas2557_set_sampling_rate(pTAS2557, params_rate(pParams));
+	tas2557_engine_post_rate(pTAS2557, params_rate(pParams));
 
-	mutex_unlock(&pTAS2557->codec_lock);
 	return 0;
 }
 
@@ -269,6 +330,11 @@ static int tas2557_power_ctrl_put(struct snd_kcontrol *pKcontrol,
 	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(codec);
 
 	int nPowerOn = pValue->value.integer.value[0];
+	int ret = 0;
+
+	ret = tas2557_pm_get(pTAS2557);
+	if (ret < 0)
+		return ret;
 
 	mutex_lock(&pTAS2557->codec_lock);
 
@@ -276,6 +342,7 @@ static int tas2557_power_ctrl_put(struct snd_kcontrol *pKcontrol,
 	tas2557_enable(pTAS2557, (nPowerOn != 0));
 
 	mutex_unlock(&pTAS2557->codec_lock);
+	tas2557_pm_put(pTAS2557);
 	return 0;
 }
 
@@ -313,12 +380,17 @@ static int tas2557_fs_put(struct snd_kcontrol *pKcontrol,
 	int ret = 0;
 	int nFS = pValue->value.integer.value[0];
 
+	ret = tas2557_pm_get(pTAS2557);
+	if (ret < 0)
+		return ret;
+
 	mutex_lock(&pTAS2557->codec_lock);
 
 	dev_info(pTAS2557->dev, "tas2557_fs_put = %d\n", nFS);
 	ret = tas2557_set_sampling_rate(pTAS2557, nFS);
 
 	mutex_unlock(&pTAS2557->codec_lock);
+	tas2557_pm_put(pTAS2557);
 	return ret;
 }
 
@@ -375,15 +447,26 @@ static int tas2557_program_put(struct snd_kcontrol *pKcontrol,
 #endif
 	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(codec);
 	unsigned int nProgram = pValue->value.integer.value[0];
-	int ret = 0, nConfiguration = -1;
+	int ret = 0;
+
+	tas2557_post_load(pTAS2557, nProgram, TAS2557_LOAD_KEEP_CONFIG);
+
+	ret = tas2557_pm_get(pTAS2557);
+	if (ret < 0)
+		return ret;
 
 	mutex_lock(&pTAS2557->codec_lock);
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
 
-	if (nProgram == pTAS2557->mnCurrentProgram)
-		nConfiguration = pTAS2557->mnCurrentConfiguration;
-	ret = tas2557_set_program(pTAS2557, nProgram, nConfiguration);
+	ret = tas2557_apply_load(pTAS2557);
 
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
 	mutex_unlock(&pTAS2557->codec_lock);
+	tas2557_pm_put(pTAS2557);
 	return ret;
 }
 
@@ -419,12 +502,25 @@ static int tas2557_configuration_put(struct snd_kcontrol *pKcontrol,
 	unsigned int nConfiguration = pValue->value.integer.value[0];
 	int ret = 0;
 
+	dev_info(pTAS2557->dev, "%s = %d\n", __func__, nConfiguration);
+	tas2557_post_load(pTAS2557, TAS2557_LOAD_UNCHANGED, nConfiguration);
+
+	ret = tas2557_pm_get(pTAS2557);
+	if (ret < 0)
+		return ret;
+
 	mutex_lock(&pTAS2557->codec_lock);
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
 
-	dev_info(pTAS2557->dev, "%s = %d\n", __func__, nConfiguration);
-	ret = tas2557_set_config(pTAS2557, nConfiguration);
+	ret = tas2557_apply_load(pTAS2557);
 
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
 	mutex_unlock(&pTAS2557->codec_lock);
+	tas2557_pm_put(pTAS2557);
 	return ret;
 }
 
@@ -461,14 +557,166 @@ static int tas2557_calibration_put(struct snd_kcontrol *pKcontrol,
 	unsigned int nCalibration = pValue->value.integer.value[0];
 	int ret = 0;
 
+	ret = tas2557_pm_get(pTAS2557);
+	if (ret < 0)
+		return ret;
+
 	mutex_lock(&pTAS2557->codec_lock);
 
 	ret = tas2557_set_calibration(pTAS2557, nCalibration);
 
 	mutex_unlock(&pTAS2557->codec_lock);
+	tas2557_pm_put(pTAS2557);
+	return ret;
+}
+
+static int tas2557_verify_policy_get(struct snd_kcontrol *pKcontrol,
+	struct snd_ctl_elem_value *pValue)
+{
+#ifdef KCONTROL_CODEC
+	struct snd_soc_codec *codec = snd_soc_kcontrol_codec(pKcontrol);
+#else
+	struct snd_soc_codec *codec = snd_kcontrol_chip(pKcontrol);
+#endif
+	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(codec);
+
+	mutex_lock(&pTAS2557->codec_lock);
+
+	pValue->value.enumerated.item[0] = pTAS2557->mnVerifyPolicy;
+
+	mutex_unlock(&pTAS2557->codec_lock);
+	return 0;
+}
+
+static int tas2557_verify_policy_put(struct snd_kcontrol *pKcontrol,
+	struct snd_ctl_elem_value *pValue)
+{
+#ifdef KCONTROL_CODEC
+	struct snd_soc_codec *codec = snd_soc_kcontrol_codec(pKcontrol);
+#else
+	struct snd_soc_codec *codec = snd_kcontrol_chip(pKcontrol);
+#endif
+	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(codec);
+	unsigned int nPolicy = pValue->value.enumerated.item[0];
+	int ret = 0;
+
+	mutex_lock(&pTAS2557->codec_lock);
+
+	ret = tas2557_set_verify_policy(pTAS2557, nPolicy, pTAS2557->mnVerifySamplePct);
+
+	mutex_unlock(&pTAS2557->codec_lock);
+	return ret;
+}
+
+static int tas2557_verify_sample_get(struct snd_kcontrol *pKcontrol,
+	struct snd_ctl_elem_value *pValue)
+{
+#ifdef KCONTROL_CODEC
+	struct snd_soc_codec *codec = snd_soc_kcontrol_codec(pKcontrol);
+#else
+	struct snd_soc_codec *codec = snd_kcontrol_chip(pKcontrol);
+#endif
+	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(codec);
+
+	mutex_lock(&pTAS2557->codec_lock);
+
+	pValue->value.integer.value[0] = pTAS2557->mnVerifySamplePct;
+
+	mutex_unlock(&pTAS2557->codec_lock);
+	return 0;
+}
+
+static int tas2557_verify_sample_put(struct snd_kcontrol *pKcontrol,
+	struct snd_ctl_elem_value *pValue)
+{
+#ifdef KCONTROL_CODEC
+	struct snd_soc_codec *codec = snd_soc_kcontrol_codec(pKcontrol);
+#else
+	struct snd_soc_codec *codec = snd_kcontrol_chip(pKcontrol);
+#endif
+	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(codec);
+	unsigned int nSamplePct = pValue->value.integer.value[0];
+	int ret = 0;
+
+	mutex_lock(&pTAS2557->codec_lock);
+
+	ret = tas2557_set_verify_policy(pTAS2557, pTAS2557->mnVerifyPolicy, nSamplePct);
+
+	mutex_unlock(&pTAS2557->codec_lock);
+	return ret;
+}
+
+static int tas2557_profile_get(struct snd_kcontrol *pKcontrol,
+	struct snd_ctl_elem_value *pValue)
+{
+#ifdef KCONTROL_CODEC
+	struct snd_soc_codec *codec = snd_soc_kcontrol_codec(pKcontrol);
+#else
+	struct snd_soc_codec *codec = snd_kcontrol_chip(pKcontrol);
+#endif
+	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(codec);
+	struct TProfile sProfile;
+	int ret;
+
+	ret = tas2557_pm_get(pTAS2557);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&pTAS2557->codec_lock);
+
+	tas2557_get_profile(pTAS2557, &sProfile);
+	memcpy(pValue->value.bytes.data, &sProfile, sizeof(sProfile));
+
+	mutex_unlock(&pTAS2557->codec_lock);
+	tas2557_pm_put(pTAS2557);
+	return 0;
+}
+
+/* TAS2557_PROFILE_UNCHANGED leaves a field as it is */
+static int tas2557_profile_put(struct snd_kcontrol *pKcontrol,
+	struct snd_ctl_elem_value *pValue)
+{
+#ifdef KCONTROL_CODEC
+	struct snd_soc_codec *codec = snd_soc_kcontrol_codec(pKcontrol);
+#else
+	struct snd_soc_codec *codec = snd_kcontrol_chip(pKcontrol);
+#endif
+	struct tas2557_priv *pTAS2557 = snd_soc_codec_get_drvdata(codec);
+	struct TProfile sProfile;
+	int ret;
+
+	memcpy(&sProfile, pValue->value.bytes.data, sizeof(sProfile));
+	dev_info(pTAS2557->dev, "%s, program %d config %d calibration %d rate %d bits %d\n",
+		__func__, sProfile.mnProgram, sProfile.mnConfiguration,
+		sProfile.mnCalibration, sProfile.mnSamplingRate, sProfile.mnBitRate);
+
+	ret = tas2557_pm_get(pTAS2557);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&pTAS2557->codec_lock);
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	ret = tas2557_set_profile(pTAS2557, &sProfile);
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+	mutex_unlock(&pTAS2557->codec_lock);
+	tas2557_pm_put(pTAS2557);
 	return ret;
 }
 
+static const char * const verify_policy_text[] = {
+	"Full", "Sampled", "CRC Only", "Off"
+};
+
+static const struct soc_enum verify_policy_enum[] = {
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(verify_policy_text), verify_policy_text),
+};
+
 static const struct snd_kcontrol_new tas2557_snd_controls[] = {
 	SOC_SINGLE_EXT("PowerCtrl", SND_SOC_NOPM, 0, 0x0001, 0,
 		tas2557_power_ctrl_get, tas2557_power_ctrl_put),
@@ -482,6 +730,12 @@ static const struct snd_kcontrol_new tas2557_snd_controls[] = {
 		tas2557_Cali_get, NULL),
 	SOC_SINGLE_EXT("Calibration", SND_SOC_NOPM, 0, 0x00FF, 0,
 		tas2557_calibration_get, tas2557_calibration_put),
+	SOC_ENUM_EXT("Verify Policy", verify_policy_enum[0],
+		tas2557_verify_policy_get, tas2557_verify_policy_put),
+	SOC_SINGLE_EXT("Verify Sample", SND_SOC_NOPM, 0, 100, 0,
+		tas2557_verify_sample_get, tas2557_verify_sample_put),
+	SND_SOC_BYTES_EXT("Profile", sizeof(struct TProfile),
+		tas2557_profile_get, tas2557_profile_put),
 };
 
 static struct snd_soc_codec_driver soc_codec_driver_tas2557 = {
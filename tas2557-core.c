@@ -37,6 +37,11 @@
 #include <linux/fcntl.h>
 #include <linux/uaccess.h>
 #include <linux/crc8.h>
+#include <linux/random.h>
+#include <linux/sort.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
+#include <linux/pm_runtime.h>
 
 #include "tas2557.h"
 #include "tas2557-core.h"
@@ -46,8 +51,9 @@
 #define	PPC_DRIVER_MTPLLSRC			0x00000400
 #define	PPC_DRIVER_CFGDEV_NONCRC	0x00000101
 
-#define TAS2557_CAL_NAME    "/data/tas2557_cal.bin"
 #define RESTART_MAX 3
+#define TAS2557_BLOCK_RETRY_MAX		6
+#define TAS2557_BURST_RETRY_MAX		3
 
 static int tas2557_load_calibration(struct tas2557_priv *pTAS2557,
 	char *pFileName);
@@ -55,11 +61,38 @@ static int tas2557_load_data(struct tas2557_priv *pTAS2557, struct TData *pData,
 	unsigned int nType);
 static void tas2557_clear_firmware(struct TFirmware *pFirmware);
 static int tas2557_load_block(struct tas2557_priv *pTAS2557, struct TBlock *pBlock);
+static void tas2557_swap_begin(struct tas2557_priv *pTAS2557);
+static int tas2557_swap_commit(struct tas2557_priv *pTAS2557, bool bApply);
+static void tas2557_post_queue(struct tas2557_priv *pTAS2557, bool bPowerUp);
+static void tas2557_preload_queue(struct tas2557_priv *pTAS2557);
+static bool isSwapReg(unsigned char nBook, unsigned char nPage, unsigned char nReg);
+static bool isSwapWrite(unsigned char nBook, unsigned char nPage, unsigned char nReg,
+	unsigned int nLength);
+static struct TShadowPage *tas2557_shadow_page(struct tas2557_priv *pTAS2557,
+	unsigned char nBook, unsigned char nPage, bool bCreate);
+static bool tas2557_prefetch_take(struct tas2557_priv *pTAS2557, int nConfiguration);
+static void tas2557_prefetch_record(struct tas2557_priv *pTAS2557, int nFrom, int nTo);
+static void tas2557_prefetch_drop(struct tas2557_priv *pTAS2557);
+static int tas2557_prefetch_unstage(struct tas2557_priv *pTAS2557);
+static void tas2557_prefetch_queue(struct tas2557_priv *pTAS2557);
 static int tas2557_load_configuration(struct tas2557_priv *pTAS2557,
 	unsigned int nConfiguration, bool bLoadSame);
+static bool tas2557_program_incremental(struct tas2557_priv *pTAS2557,
+	unsigned int nProgram, unsigned int nConfiguration);
+static unsigned int tas2557_delta_bytes(struct tas2557_priv *pTAS2557,
+	unsigned char nBook, unsigned char nPage, unsigned char nReg,
+	unsigned char *pData, unsigned int nLength);
+static int tas2557_program_image_walk(struct tas2557_priv *pTAS2557,
+	struct TProgram *pProgram, unsigned int *pnBytes);
 
 #define TAS2557_UDELAY 0xFFFFFFFE
 #define TAS2557_MDELAY 0xFFFFFFFD
+/*
+* TAS2557_UPOLL, timeout in us, followed by
+* register, (mask << 8) | value
+*/
+#define TAS2557_UPOLL 0xFFFFFFFC
+#define TAS2557_POLL_INTERVAL_US	200
 
 #define TAS2557_BLOCK_PLL				0x00
 #define TAS2557_BLOCK_PGM_ALL			0x0d
@@ -98,7 +131,8 @@ static unsigned int p_tas2557_startup_data[] = {
 	TAS2557_POWER_CTRL2_REG, 0xA0,	 /* Class-D, Boost power up */
 	TAS2557_POWER_CTRL2_REG, 0xA3,	 /* Class-D, Boost, IV sense power up */
 	TAS2557_POWER_CTRL1_REG, 0xF8,	 /* PLL, DSP, clock dividers power up */
-	TAS2557_UDELAY, 2000,		/* delay */
+	TAS2557_UPOLL, 2000,		/* wait up to 2ms for power up */
+	TAS2557_POWER_UP_FLAG_REG, (TAS2557_POWER_UP_FLAG_MASK << 8) | TAS2557_POWER_UP_FLAG_MASK,
 	TAS2557_CLK_ERR_CTRL, 0x2b,	/* enable clock error detection */
 	0xFFFFFFFF, 0xFFFFFFFF
 };
@@ -109,6 +143,41 @@ static unsigned int p_tas2557_unmute_data[] = {
 	0xFFFFFFFF, 0xFFFFFFFF
 };
 
+static unsigned int p_tas2557_mute_data[] = {
+	TAS2557_SOFT_MUTE_REG, 0x01,	 /* soft mute */
+	TAS2557_MUTE_REG, 0x03,		 /* mute */
+	0xFFFFFFFF, 0xFFFFFFFF
+};
+
+static unsigned int p_tas2557_standby_data[] = {
+	TAS2557_CLK_ERR_CTRL, 0x00,	 /* disable clock error detection */
+	TAS2557_SOFT_MUTE_REG, 0x01,	 /* soft mute */
+	TAS2557_UDELAY, 10000,		 /* delay 10ms */
+	TAS2557_MUTE_REG, 0x03,		 /* mute */
+	TAS2557_POWER_CTRL2_REG, 0x00,	 /* Class-D, Boost power down, PLL and DSP stay on */
+	0xFFFFFFFF, 0xFFFFFFFF
+};
+
+static unsigned int p_tas2557_wakeup_data[] = {
+	TAS2557_POWER_CTRL2_REG, 0xA0,	 /* Class-D, Boost power up */
+	TAS2557_POWER_CTRL2_REG, 0xA3,	 /* Class-D, Boost, IV sense power up */
+	TAS2557_UPOLL, 2000,		/* wait up to 2ms for power up */
+	TAS2557_POWER_UP_FLAG_REG, (TAS2557_POWER_UP_FLAG_MASK << 8) | TAS2557_POWER_UP_FLAG_MASK,
+	TAS2557_CLK_ERR_CTRL, 0x2b,	/* enable clock error detection */
+	0xFFFFFFFF, 0xFFFFFFFF
+};
+
+/* from standby, already muted with Class-D and boost off */
+static unsigned int p_tas2557_standby_off_data[] = {
+	TAS2557_POWER_CTRL1_REG, 0x60,	 /* DSP power down */
+	TAS2557_UDELAY, 2000,		 /* delay 2ms */
+	TAS2557_POWER_CTRL1_REG, 0x00,	 /* all power down */
+	TAS2557_GPIO1_PIN_REG, 0x00,	/* disable BCLK */
+	TAS2557_GPIO2_PIN_REG, 0x00,	/* disable WCLK */
+	TAS2557_GPI_PIN_REG, 0x00,	/* disable DIN, MCLK, CCI */
+	0xFFFFFFFF, 0xFFFFFFFF
+};
+
 static unsigned int p_tas2557_shutdown_data[] = {
 	TAS2557_CLK_ERR_CTRL, 0x00,	 /* disable clock error detection */
 	TAS2557_SOFT_MUTE_REG, 0x01,	 /* soft mute */
@@ -124,7 +193,63 @@ static unsigned int p_tas2557_shutdown_data[] = {
 	0xFFFFFFFF, 0xFFFFFFFF
 };
 
-static int tas2557_dev_load_data(struct tas2557_priv *pTAS2557,
+/*
+* sleep instead of spinning, usleep_range for the short waits
+* where msleep would overshoot by a jiffy or more
+*/
+static void tas2557_sleep_us(unsigned int nUs)
+{
+	if (nUs < 10)
+		udelay(nUs);
+	else if (nUs < 20000)
+		usleep_range(nUs, nUs + (nUs >> 3));
+	else
+		msleep(DIV_ROUND_UP(nUs, 1000));
+}
+
+/*
+* poll until (reg & mask) == value, a timeout is not fatal,
+* the sequence continues as it did after a fixed delay
+*/
+static int tas2557_dev_poll(struct tas2557_priv *pTAS2557, unsigned int nRegister,
+	unsigned int nMask, unsigned int nValue, unsigned int nTimeoutUs)
+{
+	int nResult = 0;
+	unsigned int nRead = 0;
+	ktime_t timeout = ktime_add_us(ktime_get(), nTimeoutUs);
+
+	while (1) {
+		nResult = pTAS2557->read(pTAS2557, nRegister, &nRead);
+		if (nResult < 0)
+			break;
+		if ((nRead & nMask) == nValue)
+			break;
+		if (ktime_after(ktime_get(), timeout)) {
+			dev_warn(pTAS2557->dev, "poll B[%d]P[%d]R[%d] timeout, 0x%x\n",
+				TAS2557_BOOK_ID(nRegister), TAS2557_PAGE_ID(nRegister),
+				TAS2557_PAGE_REG(nRegister), nRead);
+			break;
+		}
+		usleep_range(TAS2557_POLL_INTERVAL_US, TAS2557_POLL_INTERVAL_US * 2);
+	}
+
+	return nResult;
+}
+
+/*
+* mnErrCode is also updated by the register access layer under
+* dev_lock, every other update goes through here
+*/
+void tas2557_update_error(struct tas2557_priv *pTAS2557,
+	unsigned int nMask, unsigned int nValue)
+{
+	mutex_lock(&pTAS2557->dev_lock);
+	pTAS2557->mnErrCode = (pTAS2557->mnErrCode & ~nMask) | (nValue & nMask);
+	mutex_unlock(&pTAS2557->dev_lock);
+}
+
+/* register sequence, called with fault_lock held */
+static int tas2557_dev_load_seq(struct tas2557_priv *pTAS2557,
 	unsigned int *pData)
 {
 	int ret = 0;
@@ -136,8 +261,14 @@ static int tas2557_dev_load_data(struct tas2557_priv *pTAS2557,
 		nRegister = pData[n * 2];
 		nData = pData[n * 2 + 1];
 		if (nRegister == TAS2557_UDELAY)
-			udelay(nData);
-		else if (nRegister != 0xFFFFFFFF) {
+			tas2557_sleep_us(nData);
+		else if (nRegister == TAS2557_UPOLL) {
+			n++;
+			ret = tas2557_dev_poll(pTAS2557, pData[n * 2],
+				(pData[n * 2 + 1] >> 8) & 0xff, pData[n * 2 + 1] & 0xff, nData);
+			if (ret < 0)
+				break;
+		} else if (nRegister != 0xFFFFFFFF) {
 			ret = pTAS2557->write(pTAS2557, nRegister, nData);
 			if (ret < 0)
 				break;
@@ -147,6 +278,18 @@ static int tas2557_dev_load_data(struct tas2557_priv *pTAS2557,
 	return ret;
 }
 
+static int tas2557_dev_load_data(struct tas2557_priv *pTAS2557,
+	unsigned int *pData)
+{
+	int ret;
+
+	mutex_lock(&pTAS2557->fault_lock);
+	ret = tas2557_dev_load_seq(pTAS2557, pData);
+	mutex_unlock(&pTAS2557->fault_lock);
+
+	return ret;
+}
+
 int tas2557_configIRQ(struct tas2557_priv *pTAS2557)
 {
 	return tas2557_dev_load_data(pTAS2557, p_tas2557_irq_config);
@@ -289,10 +432,68 @@ end:
 	return nResult;
 }
 
+/*
+* runtime PM reference for hardware access, the resume callback takes
+* codec_lock and file_lock so it must be taken before them
+*/
+int tas2557_pm_get(struct tas2557_priv *pTAS2557)
+{
+	int nResult;
+
+	nResult = pm_runtime_get_sync(pTAS2557->dev);
+	if (nResult < 0) {
+		dev_err(pTAS2557->dev, "%s, resume failed %d\n", __func__, nResult);
+		pm_runtime_put_noidle(pTAS2557->dev);
+		return nResult;
+	}
+
+	return 0;
+}
+
+void tas2557_pm_put(struct tas2557_priv *pTAS2557)
+{
+	pm_runtime_mark_last_busy(pTAS2557->dev);
+	pm_runtime_put_autosuspend(pTAS2557->dev);
+}
+
+/*
+* a powered up amplifier keeps the device resumed, whoever powered it;
+* called with the locks held, so never resumes and only queues the suspend
+*/
+static void tas2557_power_ref(struct tas2557_priv *pTAS2557, bool bPowerUp)
+{
+	if (pTAS2557->mbPowerRef == bPowerUp)
+		return;
+
+	pTAS2557->mbPowerRef = bPowerUp;
+	if (bPowerUp)
+		pm_runtime_get_noresume(pTAS2557->dev);
+	else
+		tas2557_pm_put(pTAS2557);
+}
+
+/* after a reload, put back the mute the last power up applied */
+static int tas2557_load_mute(struct tas2557_priv *pTAS2557)
+{
+	if (pTAS2557->mbMuted)
+		return tas2557_dev_load_data(pTAS2557, p_tas2557_mute_data);
+
+	return tas2557_dev_load_data(pTAS2557, p_tas2557_unmute_data);
+}
+
+/*
+* stop the output on a critical fault, the state is left to the reload;
+* called with fault_lock held, so it can't land inside a block or sequence
+*/
+int tas2557_fault_shutdown(struct tas2557_priv *pTAS2557)
+{
+	return tas2557_dev_load_seq(pTAS2557, p_tas2557_shutdown_data);
+}
+
 static void failsafe(struct tas2557_priv *pTAS2557)
 {
 	dev_err(pTAS2557->dev, "%s\n", __func__);
-	pTAS2557->mnErrCode |= ERROR_FAILSAFE;
+	tas2557_update_error(pTAS2557, ERROR_FAILSAFE, ERROR_FAILSAFE);
 	if (hrtimer_active(&pTAS2557->mtimer))
 		hrtimer_cancel(&pTAS2557->mtimer);
 
@@ -307,14 +508,82 @@ static void failsafe(struct tas2557_priv *pTAS2557)
 	pTAS2557->enableIRQ(pTAS2557, false, false);
 	tas2557_dev_load_data(pTAS2557, p_tas2557_shutdown_data);
 	pTAS2557->mbPowerUp = false;
+	tas2557_power_ref(pTAS2557, false);
+	pTAS2557->mbStandby = false;
+	pTAS2557->mbResetRequired = true;
+	tas2557_prefetch_drop(pTAS2557);
 	pTAS2557->hw_reset(pTAS2557);
 	pTAS2557->write(pTAS2557, TAS2557_SW_RESET_REG, 0x01);
-	udelay(1000);
+	tas2557_sleep_us(TAS2557_SW_RESET_US);
 	pTAS2557->write(pTAS2557, TAS2557_SPK_CTRL_REG, 0x04);
 	if (pTAS2557->mpFirmware != NULL)
 		tas2557_clear_firmware(pTAS2557->mpFirmware);
 }
 
+/*
+* stream mute only, the power state is left to the power sequences;
+* a mute while powered down is applied at the next power up
+*/
+int tas2557_set_mute(struct tas2557_priv *pTAS2557, bool bMute)
+{
+	int nResult = 0;
+
+	dev_dbg(pTAS2557->dev, "%s, %d\n", __func__, bMute);
+	pTAS2557->mbMute = bMute;
+	if (!pTAS2557->mbPowerUp)
+		goto end;
+
+	pTAS2557->mbMuted = bMute;
+	nResult = tas2557_load_mute(pTAS2557);
+	if (nResult < 0) {
+		if (pTAS2557->mnErrCode & ERROR_DEVA_I2C_COMM)
+			failsafe(pTAS2557);
+		goto end;
+	}
+
+	if (!bMute)
+		tas2557_post_queue(pTAS2557, false);
+
+end:
+
+	return nResult;
+}
+
+/* leave warm standby for a full power down */
+int tas2557_standby_off(struct tas2557_priv *pTAS2557)
+{
+	int nResult = 0;
+
+	if (!pTAS2557->mbStandby)
+		goto end;
+
+	dev_dbg(pTAS2557->dev, "%s\n", __func__);
+	nResult = tas2557_prefetch_unstage(pTAS2557);
+	if (nResult < 0)
+		goto end;
+	pTAS2557->mbStandby = false;
+	nResult = tas2557_dev_load_data(pTAS2557, p_tas2557_standby_off_data);
+
+end:
+
+	return nResult;
+}
+
+/*
+* 0 disables warm standby, the device then powers down fully on stream stop;
+* the caller sets the matching autosuspend delay before taking the locks
+*/
+int tas2557_set_standby_timeout(struct tas2557_priv *pTAS2557, unsigned int nTimeoutMs)
+{
+	int nResult = 0;
+
+	pTAS2557->mnStandbyTimeoutMs = nTimeoutMs;
+	if (!nTimeoutMs)
+		nResult = tas2557_standby_off(pTAS2557);
+
+	return nResult;
+}
+
 int tas2557_checkPLL(struct tas2557_priv *pTAS2557)
 {
 	int nResult = 0;
@@ -325,6 +594,95 @@ int tas2557_checkPLL(struct tas2557_priv *pTAS2557)
 	return nResult;
 }
 
+/*
+* a load started by tas2557_apply_load() stops at the next stage
+* once a newer request has been posted
+*/
+static bool tas2557_load_superseded(struct tas2557_priv *pTAS2557)
+{
+	bool bSuperseded = false;
+
+	if (!pTAS2557->mnLoadSeq)
+		goto end;
+
+	spin_lock(&pTAS2557->mLoadLock);
+	bSuperseded = pTAS2557->mLoadRequest.mbPending
+		&& (pTAS2557->mLoadRequest.mnSeq != pTAS2557->mnLoadSeq);
+	spin_unlock(&pTAS2557->mLoadLock);
+
+	if (bSuperseded)
+		dev_info(pTAS2557->dev, "load %d superseded\n", pTAS2557->mnLoadSeq);
+
+end:
+
+	return bSuperseded;
+}
+
+/* PLL blocks with identical content count as the same PLL */
+static bool tas2557_same_pll(struct tas2557_priv *pTAS2557,
+	struct TConfiguration *pPrevConfiguration, struct TConfiguration *pNewConfiguration)
+{
+	struct TFirmware *pFirmware = pTAS2557->mpFirmware;
+
+	if (pPrevConfiguration->mnPLL == pNewConfiguration->mnPLL)
+		return true;
+	if ((pPrevConfiguration->mnPLL >= pFirmware->mnPLLs)
+		|| (pNewConfiguration->mnPLL >= pFirmware->mnPLLs))
+		return false;
+
+	return pFirmware->mpPLLs[pPrevConfiguration->mnPLL].mnCanonical
+		== pFirmware->mpPLLs[pNewConfiguration->mnPLL].mnCanonical;
+}
+
+/*
+* the current calibration is in both coefficient banks already, so the
+* configuration just loaded left it alone and rewriting it changes nothing
+*/
+static bool tas2557_calibration_in_place(struct tas2557_priv *pTAS2557)
+{
+	struct TData *pData;
+	struct TBlock *pBlock;
+	unsigned char *pCommand;
+	unsigned int nBlock, nCommand, nLength;
+
+	if (!pTAS2557->mbDeltaWrite || pTAS2557->mShadow.mbLost
+		|| (pTAS2557->mnCurrentCalibration >= pTAS2557->mpCalFirmware->mnCalibrations))
+		return false;
+
+	pData = &(pTAS2557->mpCalFirmware->mpCalibrations[pTAS2557->mnCurrentCalibration].mData);
+	for (nBlock = 0; nBlock < pData->mnBlocks; nBlock++) {
+		pBlock = &(pData->mpBlocks[nBlock]);
+		if (pBlock->mnType != TAS2557_BLOCK_CFG_COEFF_DEV_A)
+			continue;
+		/* written in full by tas2557_load_block() */
+		if (pBlock->mbPChkSumPresent)
+			return false;
+
+		nCommand = 0;
+		while (nCommand < pBlock->mnCommands) {
+			pCommand = pBlock->mpData + nCommand * 4;
+			nCommand++;
+			if (pCommand[2] <= 0x7F) {
+				if (isSwapReg(pCommand[0], pCommand[1], pCommand[2])
+					|| tas2557_delta_bytes(pTAS2557,
+						pCommand[0], pCommand[1], pCommand[2], &pCommand[3], 1))
+					return false;
+			} else if (pCommand[2] == 0x85) {
+				nLength = (pCommand[0] << 8) + pCommand[1];
+				if (isSwapWrite(pCommand[4], pCommand[5], pCommand[6], nLength)
+					|| tas2557_delta_bytes(pTAS2557,
+						pCommand[4], pCommand[5], pCommand[6], pCommand + 7, nLength))
+					return false;
+				nCommand++;
+				if (nLength >= 2)
+					nCommand += ((nLength - 2) / 4) + 1;
+			}
+		}
+	}
+
+	return true;
+}
+
 /*
 * tas2557_load_coefficient
 */
@@ -337,6 +695,8 @@ static int tas2557_load_coefficient(struct tas2557_priv *pTAS2557,
 	struct TConfiguration *pPrevConfiguration;
 	struct TConfiguration *pNewConfiguration;
 	bool bRestorePower = false;
+	bool bLive = false;
+	bool bStaged;
 
 	if (!pTAS2557->mpFirmware->mnConfigurations) {
 		dev_err(pTAS2557->dev, "%s, firmware not loaded\n", __func__);
@@ -359,13 +719,30 @@ static int tas2557_load_coefficient(struct tas2557_priv *pTAS2557,
 		pPrevConfiguration = &(pTAS2557->mpFirmware->mpConfigurations[nPrevConfig]);
 
 	pNewConfiguration = &(pTAS2557->mpFirmware->mpConfigurations[nNewConfig]);
+	bStaged = tas2557_prefetch_take(pTAS2557, nNewConfig);
+	tas2557_prefetch_record(pTAS2557, pTAS2557->mnCurrentConfiguration, nNewConfig);
 	pTAS2557->mnCurrentConfiguration = nNewConfig;
+	pTAS2557->mnPostConfiguration = -1;
 	if (pPrevConfiguration) {
-		if (pPrevConfiguration->mnPLL == pNewConfiguration->mnPLL) {
+		if (tas2557_same_pll(pTAS2557, pPrevConfiguration, pNewConfiguration)) {
 			dev_dbg(pTAS2557->dev, "%s, PLL same\n", __func__);
+			pTAS2557->mnCurrentSampleRate = pNewConfiguration->mnSamplingRate;
+			if (bStaged) {
+				/* coefficients already in the inactive bank, only the swap is left */
+				dev_dbg(pTAS2557->dev, "%s, config %s staged\n", __func__,
+					pNewConfiguration->mpName);
+				tas2557_swap_begin(pTAS2557);
+				bLive = true;
+				goto calibration;
+			}
+			if (bPowerOn) {
+				tas2557_swap_begin(pTAS2557);
+				bLive = true;
+			}
 			goto prog_coefficient;
 		}
 	}
+	pTAS2557->mbSwapPending = false;
 
 	pProgram = &(pTAS2557->mpFirmware->mpPrograms[pTAS2557->mnCurrentProgram]);
 	if (bPowerOn) {
@@ -391,6 +768,11 @@ static int tas2557_load_coefficient(struct tas2557_priv *pTAS2557,
 		goto end;
 	pTAS2557->mnCurrentSampleRate = pNewConfiguration->mnSamplingRate;
 
+	if (tas2557_load_superseded(pTAS2557)) {
+		nResult = -ECANCELED;
+		goto end;
+	}
+
 	dev_dbg(pTAS2557->dev, "load configuration %s conefficient pre block\n",
 		pNewConfiguration->mpName);
 	nResult = tas2557_load_data(pTAS2557, &(pNewConfiguration->mData), TAS2557_BLOCK_CFG_PRE_DEV_A);
@@ -398,6 +780,11 @@ static int tas2557_load_coefficient(struct tas2557_priv *pTAS2557,
 		goto end;
 
 prog_coefficient:
+	if (tas2557_load_superseded(pTAS2557)) {
+		nResult = -ECANCELED;
+		goto end;
+	}
+
 	dev_dbg(pTAS2557->dev, "load new configuration: %s, coeff block data\n",
 		pNewConfiguration->mpName);
 	nResult = tas2557_load_data(pTAS2557, &(pNewConfiguration->mData),
@@ -405,12 +792,20 @@ prog_coefficient:
 	if (nResult < 0)
 		goto end;
 
-	if (pTAS2557->mpCalFirmware->mnCalibrations) {
+calibration:
+	if (pTAS2557->mpCalFirmware->mnCalibrations && !tas2557_calibration_in_place(pTAS2557)) {
 		nResult = tas2557_set_calibration(pTAS2557, pTAS2557->mnCurrentCalibration);
 		if (nResult < 0)
 			goto end;
 	}
 
+	if (bLive) {
+		bLive = false;
+		nResult = tas2557_swap_commit(pTAS2557, true);
+		if (nResult < 0)
+			goto end;
+	}
+
 	if (bRestorePower) {
 		pTAS2557->clearIRQ(pTAS2557);
 		dev_dbg(pTAS2557->dev, "device powered up, load startup\n");
@@ -422,12 +817,13 @@ prog_coefficient:
 			if (nResult < 0) {
 				nResult = tas2557_dev_load_data(pTAS2557, p_tas2557_shutdown_data);
 				pTAS2557->mbPowerUp = false;
+				tas2557_power_ref(pTAS2557, false);
 				goto end;
 			}
 		}
 		dev_dbg(pTAS2557->dev,
 			"device powered up, load unmute\n");
-		nResult = tas2557_dev_load_data(pTAS2557, p_tas2557_unmute_data);
+		nResult = tas2557_load_mute(pTAS2557);
 		if (nResult < 0)
 			goto end;
 		if (pProgram->mnAppMode == TAS2557_APP_TUNINGMODE) {
@@ -439,20 +835,30 @@ prog_coefficient:
 			}
 		}
 	}
+
+	if (bPowerOn && pTAS2557->mbPowerUp)
+		tas2557_post_queue(pTAS2557, bRestorePower);
+	tas2557_prefetch_queue(pTAS2557);
 end:
+	if (bLive)
+		tas2557_swap_commit(pTAS2557, false);
 
 	return nResult;
 }
 
-int tas2557_enable(struct tas2557_priv *pTAS2557, bool bEnable)
+/*
+* power up muted if bMute, only the stream power path follows the
+* stream mute, every other power up is unmuted
+*/
+static int tas2557_enable_mute(struct tas2557_priv *pTAS2557, bool bEnable, bool bMute)
 {
 	int nResult = 0;
-	unsigned int nValue;
+	unsigned int nValue = 0;
 	struct TProgram *pProgram;
 
 	dev_dbg(pTAS2557->dev, "Enable: %d\n", bEnable);
 
-	tas2557_get_die_temperature(pTAS2770, &nValue);
+	tas2557_get_die_temperature(pTAS2557, &nValue);
 	if(nValue == 0x80000000)
 	{
 		dev_err(pTAS2557->dev, "%s, thermal sensor is wrong, mute output\n", __func__);
@@ -471,7 +877,7 @@ int tas2557_enable(struct tas2557_priv *pTAS2557, bool bEnable)
 	if ((nValue&0xff) != TAS2557_SAFE_GUARD_PATTERN) {
 		dev_err(pTAS2557->dev, "ERROR safe guard failure!\n");
 		nResult = -EPIPE;
-		pTAS2557->mnErrCode = ERROR_SAFE_GUARD;
+		tas2557_update_error(pTAS2557, ~0U, ERROR_SAFE_GUARD);
 		pTAS2557->mbPowerUp = true;
 		goto end;
 	}
@@ -479,21 +885,32 @@ int tas2557_enable(struct tas2557_priv *pTAS2557, bool bEnable)
 	pProgram = &(pTAS2557->mpFirmware->mpPrograms[pTAS2557->mnCurrentProgram]);
 	if (bEnable) {
 		if (!pTAS2557->mbPowerUp) {
-			if (pTAS2557->mbLoadConfigurationPrePowerUp) {
-				dev_dbg(pTAS2557->dev, "load coefficient before power\n");
-				pTAS2557->mbLoadConfigurationPrePowerUp = false;
-				nResult = tas2557_load_coefficient(pTAS2557,
-					pTAS2557->mnCurrentConfiguration, pTAS2557->mnNewConfiguration, false);
+			if (pTAS2557->mbStandby) {
+				/* PLL and DSP still running, only Class-D and boost to power */
+				pTAS2557->mbStandby = false;
+				pTAS2557->clearIRQ(pTAS2557);
+				dev_dbg(pTAS2557->dev, "Enable: leave standby\n");
+				nResult = tas2557_dev_load_data(pTAS2557, p_tas2557_wakeup_data);
 				if (nResult < 0)
 					goto end;
-			}
+			} else {
+				/* only if the background preload hasn't run yet */
+				if (pTAS2557->mbLoadConfigurationPrePowerUp) {
+					dev_dbg(pTAS2557->dev, "load coefficient before power\n");
+					pTAS2557->mbLoadConfigurationPrePowerUp = false;
+					nResult = tas2557_load_coefficient(pTAS2557,
+						pTAS2557->mnCurrentConfiguration, pTAS2557->mnNewConfiguration, false);
+					if (nResult < 0)
+						goto end;
+				}
 
-			pTAS2557->clearIRQ(pTAS2557);
-			/* power on device */
-			dev_dbg(pTAS2557->dev, "Enable: load startup sequence\n");
-			nResult = tas2557_dev_load_data(pTAS2557, p_tas2557_startup_data);
-			if (nResult < 0)
-				goto end;
+				pTAS2557->clearIRQ(pTAS2557);
+				/* power on device */
+				dev_dbg(pTAS2557->dev, "Enable: load startup sequence\n");
+				nResult = tas2557_dev_load_data(pTAS2557, p_tas2557_startup_data);
+				if (nResult < 0)
+					goto end;
+			}
 			if (pProgram->mnAppMode == TAS2557_APP_TUNINGMODE) {
 				nResult = tas2557_checkPLL(pTAS2557);
 				if (nResult < 0) {
@@ -501,38 +918,75 @@ int tas2557_enable(struct tas2557_priv *pTAS2557, bool bEnable)
 					goto end;
 				}
 			}
-			dev_dbg(pTAS2557->dev, "Enable: load unmute sequence\n");
-			nResult = tas2557_dev_load_data(pTAS2557, p_tas2557_unmute_data);
+			dev_dbg(pTAS2557->dev, "Enable: load mute state %d\n", bMute);
+			pTAS2557->mbMuted = bMute;
+			nResult = tas2557_load_mute(pTAS2557);
 			if (nResult < 0)
 				goto end;
 
+			/* the IRQ thread reads mbPowerUp and the IRQ state under fault_lock */
+			mutex_lock(&pTAS2557->fault_lock);
 			if (pProgram->mnAppMode == TAS2557_APP_TUNINGMODE) {
 				/* turn on IRQ */
 				pTAS2557->enableIRQ(pTAS2557, true, true);
-				if (!hrtimer_active(&pTAS2557->mtimer)) {
-					pTAS2557->mnDieTvReadCounter = 0;
-					hrtimer_start(&pTAS2557->mtimer,
-						ns_to_ktime((u64)LOW_TEMPERATURE_CHECK_PERIOD * NSEC_PER_MSEC), HRTIMER_MODE_REL);
-				}
 			}
 			pTAS2557->mbPowerUp = true;
+			mutex_unlock(&pTAS2557->fault_lock);
+			if ((pProgram->mnAppMode == TAS2557_APP_TUNINGMODE)
+				&& !hrtimer_active(&pTAS2557->mtimer)) {
+				pTAS2557->mnDieTvReadCounter = 0;
+				hrtimer_start(&pTAS2557->mtimer,
+					ns_to_ktime((u64)LOW_TEMPERATURE_CHECK_PERIOD * NSEC_PER_MSEC), HRTIMER_MODE_REL);
+			}
+			tas2557_power_ref(pTAS2557, true);
 			pTAS2557->mnRestart = 0;
+			tas2557_post_queue(pTAS2557, true);
 		}
 	} else {
 		if (pTAS2557->mbPowerUp) {
 			if (hrtimer_active(&pTAS2557->mtimer))
 				hrtimer_cancel(&pTAS2557->mtimer);
 
-			dev_dbg(pTAS2557->dev, "Enable: load shutdown sequence\n");
+			if (!pTAS2557->mnStandbyTimeoutMs) {
+				nResult = tas2557_prefetch_unstage(pTAS2557);
+				if (nResult < 0)
+					goto end;
+			}
+
+			/*
+			* the sequence and the power state change in one fault_lock
+			* section, the IRQ thread's shutdown lands before or after both
+			*/
+			mutex_lock(&pTAS2557->fault_lock);
 			if (pProgram->mnAppMode == TAS2557_APP_TUNINGMODE) {
 				/* turn off IRQ */
 				pTAS2557->enableIRQ(pTAS2557, false, false);
 			}
-			nResult = tas2557_dev_load_data(pTAS2557, p_tas2557_shutdown_data);
+			if (pTAS2557->mbIRQFault) {
+				/* the fault shutdown already stopped the PLL and DSP, no standby */
+				tas2557_prefetch_drop(pTAS2557);
+				pTAS2557->mbResetRequired = true;
+				dev_dbg(pTAS2557->dev, "Enable: load shutdown sequence after fault\n");
+				nResult = tas2557_dev_load_seq(pTAS2557, p_tas2557_shutdown_data);
+			} else if (pTAS2557->mnStandbyTimeoutMs) {
+				dev_dbg(pTAS2557->dev, "Enable: enter standby\n");
+				nResult = tas2557_dev_load_seq(pTAS2557, p_tas2557_standby_data);
+				if (nResult >= 0)
+					pTAS2557->mbStandby = true;
+			} else {
+				dev_dbg(pTAS2557->dev, "Enable: load shutdown sequence\n");
+				nResult = tas2557_dev_load_seq(pTAS2557, p_tas2557_shutdown_data);
+			}
+			if (nResult >= 0)
+				pTAS2557->mbPowerUp = false;
+			mutex_unlock(&pTAS2557->fault_lock);
 			if (nResult < 0)
 				goto end;
 
-			pTAS2557->mbPowerUp = false;
+			if (pTAS2557->mbStandby)
+				tas2557_prefetch_queue(pTAS2557);
+			tas2557_power_ref(pTAS2557, false);
+			pTAS2557->mbPostPowerPending = false;
 			pTAS2557->mnRestart = 0;
 		}
 	}
@@ -548,74 +1002,299 @@ end:
 	return nResult;
 }
 
-int tas2557_set_sampling_rate(struct tas2557_priv *pTAS2557, unsigned int nSamplingRate)
+int tas2557_enable(struct tas2557_priv *pTAS2557, bool bEnable)
+{
+	return tas2557_enable_mute(pTAS2557, bEnable, false);
+}
+
+/* first configuration of the program at this rate, -1 if there is none */
+static int tas2557_find_configuration(struct tas2557_priv *pTAS2557,
+	unsigned int nProgram, unsigned int nSamplingRate)
 {
-	int nResult = 0;
 	struct TConfiguration *pConfiguration;
 	unsigned int nConfiguration;
 
-	dev_dbg(pTAS2557->dev, "tas2557_setup_clocks: nSamplingRate = %d [Hz]\n",
-		nSamplingRate);
-
-	if ((!pTAS2557->mpFirmware->mpPrograms) ||
-		(!pTAS2557->mpFirmware->mpConfigurations)) {
-		dev_err(pTAS2557->dev, "Firmware not loaded\n");
-		nResult = -EINVAL;
-		goto end;
-	}
-
-	pConfiguration = &(pTAS2557->mpFirmware->mpConfigurations[pTAS2557->mnCurrentConfiguration]);
-	if (pConfiguration->mnSamplingRate == nSamplingRate) {
-		dev_info(pTAS2557->dev, "Sampling rate for current configuration matches: %d\n",
-			nSamplingRate);
-		nResult = 0;
-		goto end;
-	}
-
 	for (nConfiguration = 0;
 		nConfiguration < pTAS2557->mpFirmware->mnConfigurations;
 		nConfiguration++) {
 		pConfiguration =
 			&(pTAS2557->mpFirmware->mpConfigurations[nConfiguration]);
 		if ((pConfiguration->mnSamplingRate == nSamplingRate)
-			&& (pConfiguration->mnProgram == pTAS2557->mnCurrentProgram)) {
-			dev_info(pTAS2557->dev,
-				"Found configuration: %s, with compatible sampling rate %d\n",
-				pConfiguration->mpName, nSamplingRate);
-			nResult = tas2557_load_configuration(pTAS2557, nConfiguration, false);
-			goto end;
-		}
+			&& (pConfiguration->mnProgram == nProgram))
+			return nConfiguration;
 	}
 
-	dev_err(pTAS2557->dev, "Cannot find a configuration that supports sampling rate: %d\n",
-		nSamplingRate);
-
-end:
-
-	return nResult;
+	return -1;
 }
 
-static void fw_print_header(struct tas2557_priv *pTAS2557, struct TFirmware *pFirmware)
+static unsigned int tas2557_bytes_cost(unsigned int nBytes)
 {
-	dev_info(pTAS2557->dev, "FW Size       = %d", pFirmware->mnFWSize);
-	dev_info(pTAS2557->dev, "Checksum      = 0x%04X", pFirmware->mnChecksum);
-	dev_info(pTAS2557->dev, "PPC Version   = 0x%04X", pFirmware->mnPPCVersion);
-	dev_info(pTAS2557->dev, "FW  Version    = 0x%04X", pFirmware->mnFWVersion);
-	dev_info(pTAS2557->dev, "Driver Version= 0x%04X", pFirmware->mnDriverVersion);
-	dev_info(pTAS2557->dev, "Timestamp     = %d", pFirmware->mnTimeStamp);
-	dev_info(pTAS2557->dev, "DDC Name      = %s", pFirmware->mpDDCName);
-	dev_info(pTAS2557->dev, "Description   = %s", pFirmware->mpDescription);
+	return (nBytes * (TAS2557_COST_BYTE_NS / 100)) / 10;
 }
 
-inline unsigned int fw_convert_number(unsigned char *pData)
+/*
+* bus time and firmware delays of one block, in us; with bDelta the
+* writes tas2557_load_block() would send as a delta against the
+* current shadow are costed at what actually goes out
+*/
+static unsigned int tas2557_block_cost(struct tas2557_priv *pTAS2557,
+	struct TBlock *pBlock, bool bDelta)
 {
-	return pData[3] + (pData[2] << 8) + (pData[1] << 16) + (pData[0] << 24);
-}
+	unsigned int nCommand = 0, nLength, nBytes = 0, nDelayUs = 0;
+	unsigned char *pCommand;
 
-static int fw_parse_header(struct tas2557_priv *pTAS2557,
-	struct TFirmware *pFirmware, unsigned char *pData, unsigned int nSize)
-{
-	unsigned char *pDataStart = pData;
+	bDelta = bDelta && pTAS2557->mbDeltaWrite && !pBlock->mbPChkSumPresent
+		&& (pBlock->mnType == TAS2557_BLOCK_CFG_COEFF_DEV_A);
+
+	while (nCommand < pBlock->mnCommands) {
+		pCommand = pBlock->mpData + nCommand * 4;
+		nCommand++;
+		if (pCommand[2] <= 0x7F) {
+			if (bDelta)
+				nBytes += tas2557_delta_bytes(pTAS2557,
+					pCommand[0], pCommand[1], pCommand[2], &pCommand[3], 1);
+			else
+				nBytes += 1 + TAS2557_COST_WRITE_HDR;
+		} else if (pCommand[2] == 0x81)
+			nDelayUs += ((pCommand[0] << 8) + pCommand[1]) * 1000;
+		else if (pCommand[2] == 0x85) {
+			nLength = (pCommand[0] << 8) + pCommand[1];
+			if (bDelta)
+				nBytes += tas2557_delta_bytes(pTAS2557,
+					pCommand[4], pCommand[5], pCommand[6], pCommand + 7, nLength);
+			else
+				nBytes += nLength + TAS2557_COST_WRITE_HDR;
+			nCommand++;
+			if (nLength >= 2)
+				nCommand += ((nLength - 2) / 4) + 1;
+		}
+	}
+
+	return tas2557_bytes_cost(nBytes) + nDelayUs;
+}
+
+static unsigned int tas2557_data_cost(struct tas2557_priv *pTAS2557,
+	struct TData *pData, unsigned int nType, bool bDelta)
+{
+	unsigned int nBlock, nCost = 0;
+
+	for (nBlock = 0; nBlock < pData->mnBlocks; nBlock++)
+		if (pData->mpBlocks[nBlock].mnType == nType)
+			nCost += tas2557_block_cost(pTAS2557, &(pData->mpBlocks[nBlock]), bDelta);
+
+	return nCost;
+}
+
+/* register sequence, polls at their timeout */
+static unsigned int tas2557_sequence_cost(unsigned int *pData)
+{
+	unsigned int n = 0, nBytes = 0, nDelayUs = 0;
+
+	while (pData[n * 2] != 0xFFFFFFFF) {
+		if (pData[n * 2] == TAS2557_UDELAY)
+			nDelayUs += pData[n * 2 + 1];
+		else if (pData[n * 2] == TAS2557_UPOLL) {
+			nDelayUs += pData[n * 2 + 1];
+			n++;
+		} else
+			nBytes += 1 + TAS2557_COST_WRITE_HDR;
+		n++;
+	}
+
+	return tas2557_bytes_cost(nBytes) + nDelayUs;
+}
+
+/* 96 kHz ROM modes stand in for their 48 kHz counterparts */
+static unsigned int tas2557_app_role(unsigned int nAppMode)
+{
+	switch (nAppMode) {
+	case TAS2557_APP_ROM1_96KHZ:
+		return TAS2557_APP_ROM1MODE;
+	case TAS2557_APP_ROM2_96KHZ:
+		return TAS2557_APP_ROM2MODE;
+	}
+
+	return nAppMode;
+}
+
+static unsigned int tas2557_program_cost(struct tas2557_priv *pTAS2557,
+	unsigned int nProgram, unsigned int nConfiguration)
+{
+	struct TProgram *pProgram = &(pTAS2557->mpFirmware->mpPrograms[nProgram]);
+	unsigned int nCost = tas2557_sequence_cost(p_tas2557_default_data);
+	unsigned int nBytes = 0;
+
+	if (tas2557_program_incremental(pTAS2557, nProgram, nConfiguration)) {
+		tas2557_program_image_walk(pTAS2557, pProgram, &nBytes);
+		return nCost + tas2557_bytes_cost(nBytes);
+	}
+
+	/* reset pulse and settle, then the software reset */
+	if (gpio_is_valid(pTAS2557->mnResetGPIO))
+		nCost += TAS2557_RESET_PULSE_US + TAS2557_RESET_SETTLE_US;
+	nCost += TAS2557_SW_RESET_US + tas2557_bytes_cost(1 + TAS2557_COST_WRITE_HDR);
+
+	return nCost + tas2557_data_cost(pTAS2557, &(pProgram->mData), TAS2557_BLOCK_PGM_DEV_A, false);
+}
+
+/*
+* cheapest configuration at this rate in any program of the same role,
+* ties go to the smaller change; nothing is loaded
+*/
+int tas2557_plan_sampling_rate(struct tas2557_priv *pTAS2557,
+	unsigned int nSamplingRate, struct TRatePlan *pPlan)
+{
+	struct TFirmware *pFirmware = pTAS2557->mpFirmware;
+	struct TConfiguration *pCurrent, *pConfiguration;
+	struct TProgram *pProgram;
+	unsigned int nConfiguration, nRole, nKind, nCost;
+	unsigned int nCalCost = 0, nCalResetCost = 0, nPowerCost = 0;
+	struct TData *pCalData;
+	bool bReset;
+	int nResult = 0;
+
+	pPlan->mnKind = TAS2557_RATE_NONE;
+	pPlan->mnProgram = -1;
+	pPlan->mnConfiguration = -1;
+	pPlan->mnCostUs = 0;
+
+	if ((!pFirmware->mpPrograms) || (!pFirmware->mpConfigurations)) {
+		dev_err(pTAS2557->dev, "Firmware not loaded\n");
+		nResult = -EINVAL;
+		goto end;
+	}
+
+	pCurrent = &(pFirmware->mpConfigurations[pTAS2557->mnCurrentConfiguration]);
+	if (pCurrent->mnSamplingRate == nSamplingRate) {
+		pPlan->mnKind = TAS2557_RATE_CURRENT;
+		pPlan->mnProgram = pTAS2557->mnCurrentProgram;
+		pPlan->mnConfiguration = pTAS2557->mnCurrentConfiguration;
+		goto end;
+	}
+
+	nRole = tas2557_app_role(pFirmware->mpPrograms[pTAS2557->mnCurrentProgram].mnAppMode);
+	if (pTAS2557->mpCalFirmware->mnCalibrations
+		&& (pTAS2557->mnCurrentCalibration < pTAS2557->mpCalFirmware->mnCalibrations)) {
+		pCalData = &(pTAS2557->mpCalFirmware->mpCalibrations[pTAS2557->mnCurrentCalibration].mData);
+		nCalCost = tas2557_data_cost(pTAS2557, pCalData, TAS2557_BLOCK_CFG_COEFF_DEV_A, true);
+		nCalResetCost = tas2557_data_cost(pTAS2557, pCalData, TAS2557_BLOCK_CFG_COEFF_DEV_A, false);
+	}
+	if (pTAS2557->mbPowerUp)
+		nPowerCost = tas2557_sequence_cost(p_tas2557_shutdown_data)
+			+ tas2557_sequence_cost(p_tas2557_startup_data);
+
+	for (nConfiguration = 0; nConfiguration < pFirmware->mnConfigurations; nConfiguration++) {
+		pConfiguration = &(pFirmware->mpConfigurations[nConfiguration]);
+		if ((pConfiguration->mnSamplingRate != nSamplingRate)
+			|| (pConfiguration->mnProgram >= pFirmware->mnPrograms)
+			|| (pConfiguration->mnPLL >= pFirmware->mnPLLs))
+			continue;
+		pProgram = &(pFirmware->mpPrograms[pConfiguration->mnProgram]);
+		if (tas2557_app_role(pProgram->mnAppMode) != nRole)
+			continue;
+
+		/* coefficients go out as a delta unless a reset clears the shadow */
+		bReset = (pConfiguration->mnProgram != pTAS2557->mnCurrentProgram)
+			&& !tas2557_program_incremental(pTAS2557, pConfiguration->mnProgram, nConfiguration);
+		nCost = tas2557_data_cost(pTAS2557, &(pConfiguration->mData),
+			TAS2557_BLOCK_CFG_COEFF_DEV_A, !bReset)
+			+ (bReset ? nCalResetCost : nCalCost);
+		if ((pConfiguration->mnProgram == pTAS2557->mnCurrentProgram)
+			&& tas2557_same_pll(pTAS2557, pCurrent, pConfiguration))
+			nKind = TAS2557_RATE_SAME_PLL;
+		else {
+			nCost += nPowerCost
+				+ tas2557_block_cost(pTAS2557,
+					&(pFirmware->mpPLLs[pConfiguration->mnPLL].mBlock), false)
+				+ tas2557_data_cost(pTAS2557, &(pConfiguration->mData),
+					TAS2557_BLOCK_CFG_PRE_DEV_A, false);
+			if (pConfiguration->mnProgram == pTAS2557->mnCurrentProgram)
+				nKind = TAS2557_RATE_SAME_PROGRAM;
+			else {
+				nKind = TAS2557_RATE_PROGRAM;
+				nCost += tas2557_program_cost(pTAS2557, pConfiguration->mnProgram, nConfiguration);
+			}
+		}
+
+		if ((pPlan->mnKind == TAS2557_RATE_NONE) || (nCost < pPlan->mnCostUs)
+			|| ((nCost == pPlan->mnCostUs) && (nKind < pPlan->mnKind))) {
+			pPlan->mnKind = nKind;
+			pPlan->mnProgram = pConfiguration->mnProgram;
+			pPlan->mnConfiguration = nConfiguration;
+			pPlan->mnCostUs = nCost;
+		}
+	}
+
+end:
+
+	return nResult;
+}
+
+int tas2557_set_sampling_rate(struct tas2557_priv *pTAS2557, unsigned int nSamplingRate)
+{
+	int nResult = 0;
+	struct TConfiguration *pConfiguration;
+	struct TRatePlan sPlan;
+
+	dev_dbg(pTAS2557->dev, "tas2557_setup_clocks: nSamplingRate = %d [Hz]\n",
+		nSamplingRate);
+
+	if ((!pTAS2557->mpFirmware->mpPrograms) ||
+		(!pTAS2557->mpFirmware->mpConfigurations)) {
+		dev_err(pTAS2557->dev, "Firmware not loaded\n");
+		nResult = -EINVAL;
+		goto end;
+	}
+
+	tas2557_plan_sampling_rate(pTAS2557, nSamplingRate, &sPlan);
+	if (sPlan.mnKind == TAS2557_RATE_CURRENT) {
+		dev_info(pTAS2557->dev, "Sampling rate for current configuration matches: %d\n",
+			nSamplingRate);
+		nResult = 0;
+		goto end;
+	}
+
+	if (sPlan.mnKind == TAS2557_RATE_NONE) {
+		dev_err(pTAS2557->dev, "Cannot find a configuration that supports sampling rate: %d\n",
+			nSamplingRate);
+		goto end;
+	}
+
+	pConfiguration = &(pTAS2557->mpFirmware->mpConfigurations[sPlan.mnConfiguration]);
+	dev_info(pTAS2557->dev,
+		"Found configuration: %s, program %d, with compatible sampling rate %d, cost %u us\n",
+		pConfiguration->mpName, sPlan.mnProgram, nSamplingRate, sPlan.mnCostUs);
+	if (sPlan.mnKind == TAS2557_RATE_PROGRAM)
+		nResult = tas2557_set_program(pTAS2557, sPlan.mnProgram, sPlan.mnConfiguration);
+	else
+		nResult = tas2557_load_configuration(pTAS2557, sPlan.mnConfiguration, false);
+
+end:
+
+	return nResult;
+}
+
+static void fw_print_header(struct tas2557_priv *pTAS2557, struct TFirmware *pFirmware)
+{
+	dev_info(pTAS2557->dev, "FW Size       = %d", pFirmware->mnFWSize);
+	dev_info(pTAS2557->dev, "Checksum      = 0x%04X", pFirmware->mnChecksum);
+	dev_info(pTAS2557->dev, "PPC Version   = 0x%04X", pFirmware->mnPPCVersion);
+	dev_info(pTAS2557->dev, "FW  Version    = 0x%04X", pFirmware->mnFWVersion);
+	dev_info(pTAS2557->dev, "Driver Version= 0x%04X", pFirmware->mnDriverVersion);
+	dev_info(pTAS2557->dev, "Timestamp     = %d", pFirmware->mnTimeStamp);
+	dev_info(pTAS2557->dev, "DDC Name      = %s", pFirmware->mpDDCName);
+	dev_info(pTAS2557->dev, "Description   = %s", pFirmware->mpDescription);
+}
+
+inline unsigned int fw_convert_number(unsigned char *pData)
+{
+	return pData[3] + (pData[2] << 8) + (pData[1] << 16) + (pData[0] << 24);
+}
+
+static int fw_parse_header(struct tas2557_priv *pTAS2557,
+	struct TFirmware *pFirmware, unsigned char *pData, unsigned int nSize)
+{
+	unsigned char *pDataStart = pData;
 	unsigned int n;
 	unsigned char pMagicNumber[] = { 0x35, 0x35, 0x35, 0x32 };
 
@@ -715,6 +1394,94 @@ static int fw_parse_block_data(struct tas2557_priv *pTAS2557, struct TFirmware *
 	return pData - pDataStart;
 }
 
+/*
+* index the coefficient words of the CFG_COEFF_DEV_A bursts by register,
+* the first burst covering a word wins as it does for the linear scan;
+* without an index tas2557_get_coefficient_in_data() falls back to it
+*/
+static void fw_index_coefficients(struct tas2557_priv *pTAS2557,
+	struct TData *pImageData)
+{
+	struct TBlock *pBlock;
+	struct TCoeffEntry *pEntry;
+	unsigned char *pCommands;
+	unsigned int nPass, nBlock, nWords = 0, nSlots = 0;
+	unsigned int i, nLen, nStart, nReg, nKey, nSlot;
+	unsigned char nBook, nPage, nOffset;
+
+	pImageData->mnCoeffSlots = 0;
+	pImageData->mpCoeffIndex = NULL;
+
+	for (nPass = 0; nPass < 2; nPass++) {
+		for (nBlock = 0; nBlock < pImageData->mnBlocks; nBlock++) {
+			pBlock = &(pImageData->mpBlocks[nBlock]);
+			if (pBlock->mnType != TAS2557_BLOCK_CFG_COEFF_DEV_A)
+				continue;
+
+			pCommands = pBlock->mpData;
+			for (i = 0; i < pBlock->mnCommands;) {
+				nOffset = pCommands[4 * i + 2];
+				if ((nOffset < 0x7f) || (nOffset == 0x81)) {
+					i++;
+					continue;
+				}
+				if (nOffset != 0x85)
+					break;
+
+				nLen = ((unsigned int)pCommands[4 * i] << 8) | pCommands[4 * i + 1];
+				nBook = pCommands[4 * i + 4];
+				nPage = pCommands[4 * i + 5];
+				nOffset = pCommands[4 * i + 6];
+				nStart = 4 * i + 7;
+				i += 2;
+				i += ((nLen - 1) / 4);
+				if ((nLen - 1) % 4)
+					i++;
+				if ((i > pBlock->mnCommands) || !nLen)
+					break;
+
+				for (nReg = (nOffset + 3) & ~0x03;
+					(nReg + 4 <= nOffset + nLen) && (nReg < 128); nReg += 4) {
+					if (nPass == 0) {
+						nWords++;
+						continue;
+					}
+
+					nKey = TAS2557_REG(nBook, nPage, nReg) + 1;
+					nSlot = jhash_1word(nKey, 0) & (nSlots - 1);
+					pEntry = &(pImageData->mpCoeffIndex[nSlot]);
+					while (pEntry->mnReg && (pEntry->mnReg != nKey)) {
+						nSlot = (nSlot + 1) & (nSlots - 1);
+						pEntry = &(pImageData->mpCoeffIndex[nSlot]);
+					}
+					if (pEntry->mnReg)
+						continue;
+
+					pEntry->mnReg = nKey;
+					pEntry->mnBlock = nBlock;
+					pEntry->mnOffset = nStart + (nReg - nOffset);
+				}
+			}
+		}
+
+		if (nPass == 0) {
+			if (!nWords)
+				return;
+
+			/* at most half full, a probe ends on an empty slot */
+			nSlots = roundup_pow_of_two(nWords * 2);
+			pImageData->mpCoeffIndex =
+				kcalloc(nSlots, sizeof(struct TCoeffEntry), GFP_KERNEL);
+			if (!pImageData->mpCoeffIndex)
+				return;
+			pImageData->mnCoeffSlots = nSlots;
+		}
+	}
+
+	dev_dbg(pTAS2557->dev, "%s, %s: %d words, %d slots\n", __func__,
+		pImageData->mpName, nWords, nSlots);
+}
+
 static int fw_parse_data(struct tas2557_priv *pTAS2557, struct TFirmware *pFirmware,
 	struct TData *pImageData, unsigned char *pData)
 {
@@ -740,9 +1507,43 @@ static int fw_parse_data(struct tas2557_priv *pTAS2557, struct TFirmware *pFirmw
 			&(pImageData->mpBlocks[nBlock]), pData);
 		pData += n;
 	}
+
+	fw_index_coefficients(pTAS2557, pImageData);
+
 	return pData - pDataStart;
 }
 
+/*
+* PLL entries that write the same registers with the same values share
+* the index of the first one, configurations are then compared by it
+*/
+static void fw_canonical_pll(struct tas2557_priv *pTAS2557,
+	struct TFirmware *pFirmware, unsigned int nPLL)
+{
+	struct TPLL *pPLL = &(pFirmware->mpPLLs[nPLL]);
+	struct TPLL *pOther;
+	unsigned int nSize = pPLL->mBlock.mnCommands * 4;
+	unsigned int n;
+
+	pPLL->mnHash = jhash(pPLL->mBlock.mpData, nSize, pPLL->mBlock.mnType);
+	pPLL->mnCanonical = nPLL;
+
+	for (n = 0; n < nPLL; n++) {
+		pOther = &(pFirmware->mpPLLs[n]);
+		if ((pOther->mnCanonical != n)
+			|| (pOther->mnHash != pPLL->mnHash)
+			|| (pOther->mBlock.mnType != pPLL->mBlock.mnType)
+			|| (pOther->mBlock.mnCommands != pPLL->mBlock.mnCommands)
+			|| memcmp(pOther->mBlock.mpData, pPLL->mBlock.mpData, nSize))
+			continue;
+
+		dev_dbg(pTAS2557->dev, "PLL %d (%s) same as PLL %d (%s)\n",
+			nPLL, pPLL->mpName, n, pOther->mpName);
+		pPLL->mnCanonical = n;
+		break;
+	}
+}
+
 static int fw_parse_pll_data(struct tas2557_priv *pTAS2557,
 	struct TFirmware *pFirmware, unsigned char *pData)
 {
@@ -770,6 +1571,8 @@ static int fw_parse_pll_data(struct tas2557_priv *pTAS2557,
 
 		n = fw_parse_block_data(pTAS2557, pFirmware, &(pPLL->mBlock), pData);
 		pData += n;
+
+		fw_canonical_pll(pTAS2557, pFirmware, nPLL);
 	}
 
 end:
@@ -919,10 +1722,314 @@ end:
 	return pData - pDataStart;
 }
 
+static int fw_image_cmp(const void *a, const void *b)
+{
+	unsigned int nA = *(const unsigned int *)a;
+	unsigned int nB = *(const unsigned int *)b;
+
+	return (nA > nB) - (nA < nB);
+}
+
+/*
+* the writes of one block as (TAS2557_REG << 8) | value, in command
+* order; -EINVAL if the block touches book/page or reset control,
+* uses an unknown command, or sleeps while bSleep is false
+*/
+static int fw_block_image(struct TBlock *pBlock, unsigned int *pEntries, bool bSleep)
+{
+	unsigned int nCommand = 0, nLength, n;
+	unsigned char *pCommand;
+	unsigned char nBook, nPage, nOffset;
+	int nRegs = 0;
+
+	while (nCommand < pBlock->mnCommands) {
+		pCommand = pBlock->mpData + nCommand * 4;
+		nBook = pCommand[0];
+		nPage = pCommand[1];
+		nOffset = pCommand[2];
+		nLength = 1;
+		nCommand++;
+		if (nOffset == 0x85) {
+			nLength = (nBook << 8) + nPage;
+			nBook = pCommand[4];
+			nPage = pCommand[5];
+			nOffset = pCommand[6];
+			pCommand += 4;
+			nCommand++;
+			if (nLength >= 2)
+				nCommand += ((nLength - 2) / 4) + 1;
+		} else if ((nOffset == 0x81) && bSleep)
+			continue;
+		else if (nOffset > 0x7F)
+			return -EINVAL;
+
+		if ((nLength == 0) || ((nOffset + nLength) > 128))
+			return -EINVAL;
+		if ((nOffset == TAS2557_PAGECTL_REG)
+			|| ((nPage == TAS2557_BOOKCTL_PAGE)
+				&& ((nOffset + nLength - 1) >= TAS2557_BOOKCTL_REG)))
+			return -EINVAL;
+		if ((nBook == 0) && (nPage == 0)
+			&& (nOffset <= TAS2557_PAGE_REG(TAS2557_SW_RESET_REG)))
+			return -EINVAL;
+
+		if (pEntries)
+			for (n = 0; n < nLength; n++)
+				pEntries[nRegs + n] =
+					(TAS2557_REG(nBook, nPage, nOffset + n) << 8) | pCommand[3 + n];
+		nRegs += nLength;
+	}
+
+	return nRegs;
+}
+
+/*
+* collect the final register values of the program blocks, a program
+* is reset only if its blocks download PRAM, sleep, touch book/page or
+* reset control, or write a register more than once
+*/
+static void fw_build_program_image(struct tas2557_priv *pTAS2557, struct TProgram *pProgram)
+{
+	struct TData *pData = &(pProgram->mData);
+	struct TBlock *pBlock;
+	unsigned int nBlock, i, nRegs = 0;
+	unsigned int *pEntries = NULL;
+	int nCount;
+
+	pProgram->mbResetOnly = true;
+	pProgram->mImage.mnRegs = 0;
+	pProgram->mImage.mpEntries = NULL;
+
+	/* pass 0 checks and counts, pass 1 fills */
+	for (i = 0; i < 2; i++) {
+		nRegs = 0;
+		for (nBlock = 0; nBlock < pData->mnBlocks; nBlock++) {
+			pBlock = &(pData->mpBlocks[nBlock]);
+			if (pBlock->mnType != TAS2557_BLOCK_PGM_DEV_A)
+				continue;
+			if (pBlock->mbPChkSumPresent)
+				goto end;
+			nCount = fw_block_image(pBlock, pEntries ? pEntries + nRegs : NULL, false);
+			if (nCount < 0)
+				goto end;
+			nRegs += nCount;
+		}
+
+		if (pEntries)
+			break;
+		if (!nRegs)
+			break;
+		pEntries = kmalloc_array(nRegs, sizeof(unsigned int), GFP_KERNEL);
+		if (!pEntries)
+			goto end;
+	}
+
+	if (pEntries) {
+		sort(pEntries, nRegs, sizeof(unsigned int), fw_image_cmp, NULL);
+		for (i = 1; i < nRegs; i++)
+			if ((pEntries[i] >> 8) == (pEntries[i - 1] >> 8))
+				goto end;
+	}
+
+	pProgram->mbResetOnly = false;
+	pProgram->mImage.mnRegs = nRegs;
+	pProgram->mImage.mpEntries = pEntries;
+	pEntries = NULL;
+
+end:
+	kfree(pEntries);
+}
+
+/*
+* the registers a configuration leaves behind, PLL, pre and coefficient
+* blocks; post blocks aren't replayed on every load, so a configuration
+* that has any stays untracked
+*/
+static void fw_build_config_image(struct TFirmware *pFirmware, struct TConfiguration *pConfiguration)
+{
+	struct TData *pData = &(pConfiguration->mData);
+	struct TBlock *pBlock;
+	unsigned int nBlock, i, nRegs = 0, nUnique;
+	unsigned int *pEntries = NULL;
+	int nCount;
+
+	pConfiguration->mbRegsTracked = false;
+	pConfiguration->mRegs.mnRegs = 0;
+	pConfiguration->mRegs.mpEntries = NULL;
+
+	if (pConfiguration->mnPLL >= pFirmware->mnPLLs)
+		return;
+
+	for (i = 0; i < 2; i++) {
+		nCount = fw_block_image(&(pFirmware->mpPLLs[pConfiguration->mnPLL].mBlock),
+			pEntries, true);
+		if (nCount < 0)
+			goto end;
+		nRegs = nCount;
+		for (nBlock = 0; nBlock < pData->mnBlocks; nBlock++) {
+			pBlock = &(pData->mpBlocks[nBlock]);
+			if (((pBlock->mnType == TAS2557_BLOCK_CFG_POST)
+				|| (pBlock->mnType == TAS2557_BLOCK_CFG_POST_POWER))
+				&& pBlock->mnCommands)
+				goto end;
+			if ((pBlock->mnType != TAS2557_BLOCK_CFG_PRE_DEV_A)
+				&& (pBlock->mnType != TAS2557_BLOCK_CFG_COEFF_DEV_A))
+				continue;
+			nCount = fw_block_image(pBlock, pEntries ? pEntries + nRegs : NULL, true);
+			if (nCount < 0)
+				goto end;
+			nRegs += nCount;
+		}
+
+		if (pEntries || !nRegs)
+			break;
+		pEntries = kmalloc_array(nRegs, sizeof(unsigned int), GFP_KERNEL);
+		if (!pEntries)
+			goto end;
+	}
+
+	/* only the register set matters, drop the values and duplicates */
+	nUnique = 0;
+	if (pEntries) {
+		for (i = 0; i < nRegs; i++)
+			pEntries[i] &= ~0xff;
+		sort(pEntries, nRegs, sizeof(unsigned int), fw_image_cmp, NULL);
+		for (i = 0; i < nRegs; i++)
+			if (!nUnique || (pEntries[i] != pEntries[nUnique - 1]))
+				pEntries[nUnique++] = pEntries[i];
+	}
+
+	pConfiguration->mbRegsTracked = true;
+	pConfiguration->mRegs.mnRegs = nUnique;
+	pConfiguration->mRegs.mpEntries = pEntries;
+	pEntries = NULL;
+
+end:
+	kfree(pEntries);
+}
+
+static bool fw_is_ram_app(unsigned char nAppMode)
+{
+	return (nAppMode == TAS2557_APP_TUNINGMODE) || (nAppMode == TAS2557_APP_RAMMODE);
+}
+
+/* every register in pFrom must be rewritten by pTo or, if given, pExtra */
+static bool fw_image_covers(struct TRegImage *pFrom, struct TRegImage *pTo,
+	struct TRegImage *pExtra)
+{
+	unsigned int i, j = 0, k = 0, nReg;
+
+	for (i = 0; i < pFrom->mnRegs; i++) {
+		nReg = pFrom->mpEntries[i] >> 8;
+		while ((j < pTo->mnRegs) && ((pTo->mpEntries[j] >> 8) < nReg))
+			j++;
+		if ((j < pTo->mnRegs) && ((pTo->mpEntries[j] >> 8) == nReg))
+			continue;
+		if (!pExtra)
+			return false;
+		while ((k < pExtra->mnRegs) && ((pExtra->mpEntries[k] >> 8) < nReg))
+			k++;
+		if ((k == pExtra->mnRegs) || ((pExtra->mpEntries[k] >> 8) != nReg))
+			return false;
+	}
+
+	return true;
+}
+
+/*
+* a configuration can be staged if its coefficient blocks carry no PRAM
+* checksum and end in a swap, the only swap they write; that swap is
+* then the only write that reaches the active bank
+*/
+static bool fw_config_swap_stage(struct TConfiguration *pConfiguration)
+{
+	struct TData *pData = &(pConfiguration->mData);
+	struct TBlock *pBlock;
+	unsigned int nBlock, nCommand, nLength, nSwaps = 0;
+	unsigned char *pCommand;
+	unsigned char nBook, nPage, nOffset;
+	bool bSwap = false;
+
+	for (nBlock = 0; nBlock < pData->mnBlocks; nBlock++) {
+		pBlock = &(pData->mpBlocks[nBlock]);
+		if (pBlock->mnType != TAS2557_BLOCK_CFG_COEFF_DEV_A)
+			continue;
+		if (pBlock->mbPChkSumPresent)
+			return false;
+
+		nCommand = 0;
+		while (nCommand < pBlock->mnCommands) {
+			pCommand = pBlock->mpData + nCommand * 4;
+			nBook = pCommand[0];
+			nPage = pCommand[1];
+			nOffset = pCommand[2];
+			nLength = 1;
+			nCommand++;
+			if (nOffset == 0x85) {
+				nLength = (nBook << 8) + nPage;
+				nBook = pCommand[4];
+				nPage = pCommand[5];
+				nOffset = pCommand[6];
+				nCommand++;
+				if (nLength >= 2)
+					nCommand += ((nLength - 2) / 4) + 1;
+			} else if (nOffset > 0x7F)
+				continue;
+
+			if (isSwapWrite(nBook, nPage, nOffset, nLength))
+				nSwaps++;
+			/* the last write decides, it must write nothing but the swap */
+			bSwap = nLength && isSwapReg(nBook, nPage, nOffset)
+				&& isSwapReg(nBook, nPage, nOffset + nLength - 1);
+		}
+	}
+
+	return bSwap && (nSwaps == 1);
+}
+
+/* classify every program transition, reset or incremental */
+static void fw_build_program_switch(struct tas2557_priv *pTAS2557, struct TFirmware *pFirmware)
+{
+	unsigned int nFrom, nTo, nIncremental = 0;
+	struct TProgram *pFrom, *pTo;
+	unsigned char nSwitch;
+
+	if (!pFirmware->mnPrograms)
+		return;
+
+	for (nTo = 0; nTo < pFirmware->mnPrograms; nTo++)
+		fw_build_program_image(pTAS2557, &(pFirmware->mpPrograms[nTo]));
+	for (nTo = 0; nTo < pFirmware->mnConfigurations; nTo++)
+		fw_build_config_image(pFirmware, &(pFirmware->mpConfigurations[nTo]));
+
+	pFirmware->mpProgramSwitch = kcalloc(pFirmware->mnPrograms, pFirmware->mnPrograms, GFP_KERNEL);
+	if (!pFirmware->mpProgramSwitch)
+		return;
+
+	for (nFrom = 0; nFrom < pFirmware->mnPrograms; nFrom++) {
+		pFrom = &(pFirmware->mpPrograms[nFrom]);
+		for (nTo = 0; nTo < pFirmware->mnPrograms; nTo++) {
+			pTo = &(pFirmware->mpPrograms[nTo]);
+			nSwitch = TAS2557_SWITCH_RESET;
+			if (!pFrom->mbResetOnly && !pTo->mbResetOnly
+				&& (fw_is_ram_app(pFrom->mnAppMode) == fw_is_ram_app(pTo->mnAppMode))
+				&& fw_image_covers(&(pFrom->mImage), &(pTo->mImage), NULL)) {
+				nSwitch = TAS2557_SWITCH_INCREMENTAL;
+				nIncremental++;
+			}
+			pFirmware->mpProgramSwitch[nFrom * pFirmware->mnPrograms + nTo] = nSwitch;
+		}
+	}
+
+	dev_dbg(pTAS2557->dev, "%d of %d program switches without reset\n",
+		nIncremental, pFirmware->mnPrograms * pFirmware->mnPrograms);
+}
+
 static int fw_parse(struct tas2557_priv *pTAS2557,
 	struct TFirmware *pFirmware, unsigned char *pData, unsigned int nSize)
 {
 	int nPosition = 0;
+	unsigned int nConfiguration;
 
 	nPosition = fw_parse_header(pTAS2557, pFirmware, pData, nSize);
 	if (nPosition < 0) {
@@ -959,6 +2066,12 @@ static int fw_parse(struct tas2557_priv *pTAS2557,
 
 	if (nSize > 64)
 		nPosition = fw_parse_calibration_data(pTAS2557, pFirmware, pData);
+
+	for (nConfiguration = 0; nConfiguration < pFirmware->mnConfigurations; nConfiguration++)
+		pFirmware->mpConfigurations[nConfiguration].mbSwapStage =
+			fw_config_swap_stage(&(pFirmware->mpConfigurations[nConfiguration]));
+
+	fw_build_program_switch(pTAS2557, pFirmware);
 	return 0;
 }
 
@@ -1136,92 +2249,395 @@ static u8 ti_crc8(const u8 table[CRC8_TABLE_SIZE], u8 *pdata, size_t nbytes, u8
 	return crc;
 }
 
-static int doSingleRegCheckSum(struct tas2557_priv *pTAS2557, 
-	unsigned char nBook, unsigned char nPage, unsigned char nReg, unsigned char nValue)
+static bool isSwapReg(unsigned char nBook, unsigned char nPage, unsigned char nReg)
 {
-	int nResult = 0;
-	struct TYCRC sCRCData;
-	unsigned int nData1 = 0;
-
-	if ((nBook == TAS2557_BOOK_ID(TAS2557_SA_COEFF_SWAP_REG))
+	return (nBook == TAS2557_BOOK_ID(TAS2557_SA_COEFF_SWAP_REG))
 		&& (nPage == TAS2557_PAGE_ID(TAS2557_SA_COEFF_SWAP_REG))
 		&& (nReg >= TAS2557_PAGE_REG(TAS2557_SA_COEFF_SWAP_REG))
-		&& (nReg <= (TAS2557_PAGE_REG(TAS2557_SA_COEFF_SWAP_REG) + 4))) {
-		/* DSP swap command, pass */
-		nResult = 0;
-		goto end;
+		&& (nReg <= (TAS2557_PAGE_REG(TAS2557_SA_COEFF_SWAP_REG) + 4));
+}
+
+static bool isSwapWrite(unsigned char nBook, unsigned char nPage, unsigned char nReg,
+	unsigned int nLength)
+{
+	unsigned int i;
+
+	for (i = 0; i < nLength; i++)
+		if (isSwapReg(nBook, nPage, nReg + i))
+			return true;
+
+	return false;
+}
+
+/*
+* write one command or burst of a block, an I2C error only repeats this write;
+* while a block is loading everything but the swap joins the pending batch
+*/
+static int tas2557_write_burst(struct tas2557_priv *pTAS2557,
+	unsigned char nBook, unsigned char nPage, unsigned char nReg,
+	unsigned char *pData, unsigned int nLength)
+{
+	int nResult = 0;
+	int nRetry = TAS2557_BURST_RETRY_MAX;
+
+	if (pTAS2557->mbBatchOpen && !isSwapWrite(nBook, nPage, nReg, nLength))
+		return pTAS2557->batch_write(pTAS2557,
+			TAS2557_REG(nBook, nPage, nReg), pData, nLength);
+
+	do {
+		if (nLength > 1)
+			nResult = pTAS2557->bulk_write(pTAS2557,
+				TAS2557_REG(nBook, nPage, nReg), pData, nLength);
+		else
+			nResult = pTAS2557->write(pTAS2557,
+				TAS2557_REG(nBook, nPage, nReg), pData[0]);
+		if (nResult >= 0)
+			break;
+		dev_err(pTAS2557->dev, "B[0x%x]P[0x%x]R[0x%x] len %d write error %d\n",
+			nBook, nPage, nReg, nLength, nResult);
+		nRetry--;
+	} while (nRetry > 0);
+
+	return nResult;
+}
+
+/* the byte holds nValue whichever bank the last swap left writable */
+static bool tas2557_shadow_match(struct TShadowPage *pPage, unsigned int nReg,
+	unsigned char nValue)
+{
+	unsigned char nMask = 1 << (nReg & 7);
+
+	if (nReg > 0x7F)
+		return false;
+
+	return (pPage->mpBankValid[0][nReg >> 3] & pPage->mpBankValid[1][nReg >> 3] & nMask)
+		&& (pPage->mpBank[0][nReg] == nValue)
+		&& (pPage->mpBank[1][nReg] == nValue);
+}
+
+/*
+* a byte is skipped only if both bank parities hold it; YRAM keeps what
+* was written, as the read-back verification relies on, except for the
+* R0 and T words the DSP measures into during a calibration run, which
+* tas2557_run_calibration() drops from the shadow
+*/
+static bool tas2557_delta_skip(struct tas2557_priv *pTAS2557, struct TShadowPage *pPage,
+	unsigned int nReg, unsigned char nValue)
+{
+	return pPage && tas2557_shadow_match(pPage, nReg, nValue);
+}
+
+/*
+* next run of a command that differs from the shadow, from *pnStart on;
+* runs separated by a few matching bytes are merged into one. *pnStart
+* is moved past the skipped bytes, the end of the run is returned
+*/
+static unsigned int tas2557_delta_run(struct tas2557_priv *pTAS2557, struct TShadowPage *pPage,
+	unsigned char nReg, unsigned char *pData, unsigned int nLength, unsigned int *pnStart)
+{
+	unsigned int nStart = *pnStart, nEnd, nGap;
+
+	while ((nStart < nLength) && tas2557_delta_skip(pTAS2557, pPage, nReg + nStart, pData[nStart]))
+		nStart++;
+	*pnStart = nStart;
+	if (nStart == nLength)
+		return nLength;
+
+	nEnd = nStart + 1;
+	while (nEnd < nLength) {
+		if (!tas2557_delta_skip(pTAS2557, pPage, nReg + nEnd, pData[nEnd])) {
+			nEnd++;
+			continue;
+		}
+		for (nGap = nEnd; nGap < nLength; nGap++)
+			if (!tas2557_delta_skip(pTAS2557, pPage, nReg + nGap, pData[nGap]))
+				break;
+		if ((nGap == nLength) || ((nGap - nEnd) > TAS2557_DELTA_GAP))
+			break;
+		nEnd = nGap;
+	}
+
+	return nEnd;
+}
+
+static struct TShadowPage *tas2557_delta_page(struct tas2557_priv *pTAS2557,
+	unsigned char nBook, unsigned char nPage)
+{
+	if (pTAS2557->mShadow.mbLost)
+		return NULL;
+
+	return tas2557_shadow_page(pTAS2557, nBook, nPage, false);
+}
+
+/* write only the runs of a command that differ from the shadow */
+static int tas2557_write_delta(struct tas2557_priv *pTAS2557,
+	unsigned char nBook, unsigned char nPage, unsigned char nReg,
+	unsigned char *pData, unsigned int nLength)
+{
+	struct TShadowPage *pPage = tas2557_delta_page(pTAS2557, nBook, nPage);
+	unsigned int nStart = 0, nEnd, nWritten = 0;
+	int nResult = 0;
+
+	while (1) {
+		nEnd = tas2557_delta_run(pTAS2557, pPage, nReg, pData, nLength, &nStart);
+		if (nStart == nLength)
+			break;
+		nResult = tas2557_write_burst(pTAS2557, nBook, nPage, nReg + nStart,
+			pData + nStart, nEnd - nStart);
+		if (nResult < 0)
+			goto end;
+		nWritten += nEnd - nStart;
+		nStart = nEnd;
+	}
+
+	pTAS2557->mnDeltaWritten += nWritten;
+	pTAS2557->mnDeltaSkipped += nLength - nWritten;
+
+end:
+
+	return nResult;
+}
+
+/* bus bytes tas2557_write_delta() would send for a command */
+static unsigned int tas2557_delta_bytes(struct tas2557_priv *pTAS2557,
+	unsigned char nBook, unsigned char nPage, unsigned char nReg,
+	unsigned char *pData, unsigned int nLength)
+{
+	struct TShadowPage *pPage = tas2557_delta_page(pTAS2557, nBook, nPage);
+	unsigned int nStart = 0, nEnd, nBytes = 0;
+
+	while (1) {
+		nEnd = tas2557_delta_run(pTAS2557, pPage, nReg, pData, nLength, &nStart);
+		if (nStart == nLength)
+			break;
+		nBytes += nEnd - nStart + TAS2557_COST_WRITE_HDR;
+		nStart = nEnd;
+	}
+
+	return nBytes;
+}
+
+/* write the held swap now, the DSP flips the banks at its next frame */
+static int tas2557_swap_flush(struct tas2557_priv *pTAS2557)
+{
+	int nResult = 0;
+
+	if (!pTAS2557->mbSwapPending)
+		goto end;
+
+	pTAS2557->mbSwapPending = false;
+	dev_dbg(pTAS2557->dev, "commit coefficient swap\n");
+	nResult = tas2557_write_burst(pTAS2557,
+		TAS2557_BOOK_ID(TAS2557_SA_COEFF_SWAP_REG), TAS2557_PAGE_ID(TAS2557_SA_COEFF_SWAP_REG),
+		pTAS2557->mnSwapReg, pTAS2557->mpSwapData, pTAS2557->mnSwapLen);
+
+end:
+
+	return nResult;
+}
+
+/*
+* during a live update a command that only writes the swap register is
+* recorded instead of written, PRAM blocks are never deferred; a swap
+* already held goes out before any later one, so the firmware's swaps
+* keep their order and only the last waits for the commit.
+* 1 if held, 0 if the caller writes the command, < 0 on error
+*/
+static int tas2557_swap_hold(struct tas2557_priv *pTAS2557, struct TBlock *pBlock,
+	unsigned char nBook, unsigned char nPage, unsigned char nReg,
+	unsigned char *pData, unsigned int nLength)
+{
+	int nResult;
+
+	if (!pTAS2557->mnSwapDepth || !isSwapWrite(nBook, nPage, nReg, nLength))
+		return 0;
+
+	nResult = tas2557_swap_flush(pTAS2557);
+	if (nResult < 0)
+		return nResult;
+
+	if (pBlock->mbPChkSumPresent
+		|| (nLength > sizeof(pTAS2557->mpSwapData))
+		|| !isSwapReg(nBook, nPage, nReg)
+		|| !isSwapReg(nBook, nPage, nReg + nLength - 1))
+		return 0;
+
+	pTAS2557->mnSwapReg = nReg;
+	pTAS2557->mnSwapLen = nLength;
+	memcpy(pTAS2557->mpSwapData, pData, nLength);
+	pTAS2557->mbSwapPending = true;
+	pTAS2557->mnSwapLevel = pTAS2557->mnSwapDepth;
+
+	return 1;
+}
+
+/* start holding back swap commands, updates nest, each begin needs a commit */
+static void tas2557_swap_begin(struct tas2557_priv *pTAS2557)
+{
+	pTAS2557->mnSwapDepth++;
+}
+
+/*
+* end one level of a live update, an inner level hands its held swap
+* to the outer one and the outermost writes it; after a failed update
+* the swap held at this level is dropped, the inactive bank stays unswapped
+*/
+static int tas2557_swap_commit(struct tas2557_priv *pTAS2557, bool bApply)
+{
+	int nResult = 0;
+
+	if (!pTAS2557->mnSwapDepth)
+		goto end;
+
+	pTAS2557->mnSwapDepth--;
+	if (!pTAS2557->mbSwapPending)
+		goto end;
+
+	if (!bApply) {
+		if (pTAS2557->mnSwapLevel > pTAS2557->mnSwapDepth)
+			pTAS2557->mbSwapPending = false;
+		goto end;
+	}
+
+	if (pTAS2557->mnSwapDepth) {
+		if (pTAS2557->mnSwapLevel > pTAS2557->mnSwapDepth)
+			pTAS2557->mnSwapLevel = pTAS2557->mnSwapDepth;
+		goto end;
 	}
 
-	nResult = isYRAM(pTAS2557, &sCRCData, nBook, nPage, nReg, 1);
-	if (nResult == 1) {
-		nResult = pTAS2557->read(pTAS2557, TAS2557_REG(nBook, nPage, nReg), &nData1);
+	nResult = tas2557_swap_flush(pTAS2557);
+
+end:
+
+	return nResult;
+}
+
+/*
+* read back the YRAM bytes recorded in pYPage with one bulk read,
+* compare them with what was written and add their crc8 to the checksum,
+* mismatched runs are rewritten and the page is read back again
+*/
+static int doYRAMPageCheckSum(struct tas2557_priv *pTAS2557,
+	struct TYRAMPage *pYPage, unsigned char *pCRCChkSum)
+{
+	int nResult = 0, i, nRun;
+	int nRetry = TAS2557_BURST_RETRY_MAX;
+	unsigned char nLen, nCRCChkSum, nMismatch;
+	unsigned char nBuf1[128];
+	unsigned char pBad[128];
+
+	if (!pYPage->mbDirty)
+		goto end;
+
+	nLen = pYPage->mnEnd - pYPage->mnStart + 1;
+	while (1) {
+		nResult = pTAS2557->bulk_read(pTAS2557,
+			TAS2557_REG(pYPage->mnBook, pYPage->mnPage, pYPage->mnStart), nBuf1, nLen);
 		if (nResult < 0)
 			goto end;
+		pYPage->mnBytesRead += nLen;
+
+		nCRCChkSum = 0;
+		nMismatch = 0;
+		memset(pBad, 0, sizeof(pBad));
+		for (i = pYPage->mnStart; i <= pYPage->mnEnd; i++) {
+			if (!pYPage->mpWritten[i])
+				continue;
+
+			if (nBuf1[i - pYPage->mnStart] != pYPage->mpData[i]) {
+				dev_err(pTAS2557->dev, "error2 (line %d),B[0x%x]P[0x%x]R[0x%x] W[0x%x], R[0x%x]\n",
+					__LINE__, pYPage->mnBook, pYPage->mnPage, i,
+					pYPage->mpData[i], nBuf1[i - pYPage->mnStart]);
+				pBad[i] = 1;
+				nMismatch++;
+				continue;
+			}
+
+			nCRCChkSum += ti_crc8(crc8_lookup_table, &nBuf1[i - pYPage->mnStart], 1, 0);
+		}
+
+		if (nMismatch == 0) {
+			*pCRCChkSum += nCRCChkSum;
+			break;
+		}
 
-		if (nData1 != nValue) {
-			dev_err(pTAS2557->dev, "error2 (line %d),B[0x%x]P[0x%x]R[0x%x] W[0x%x], R[0x%x]\n",
-				__LINE__, nBook, nPage, nReg, nValue, nData1);
+		nRetry--;
+		if (nRetry <= 0) {
 			nResult = -EAGAIN;
 			goto end;
 		}
 
-		nResult = ti_crc8(crc8_lookup_table, &nValue, 1, 0);
+		/* only rewrite the runs that did not read back */
+		for (i = pYPage->mnStart; i <= pYPage->mnEnd; i += nRun) {
+			nRun = 1;
+			if (!pBad[i])
+				continue;
+			while (((i + nRun) <= pYPage->mnEnd) && pBad[i + nRun])
+				nRun++;
+			nResult = tas2557_write_burst(pTAS2557, pYPage->mnBook,
+				pYPage->mnPage, i, &pYPage->mpData[i], nRun);
+			if (nResult < 0)
+				goto end;
+		}
 	}
 
 end:
+	pYPage->mbDirty = false;
+	memset(pYPage->mpWritten, 0, sizeof(pYPage->mpWritten));
 
 	return nResult;
 }
 
-static int doMultiRegCheckSum(struct tas2557_priv *pTAS2557, 
-	unsigned char nBook, unsigned char nPage, unsigned char nReg, unsigned int len)
+/*
+* record the YRAM part of a register write for page-wise read back,
+* the page recorded so far is verified first if the write moves to another
+* page or rewrites a byte that was not verified yet
+*/
+static int doYRAMTrack(struct tas2557_priv *pTAS2557, struct TYRAMPage *pYPage,
+	unsigned char nBook, unsigned char nPage, unsigned char nReg,
+	unsigned char *pData, unsigned int len, unsigned char *pCRCChkSum)
 {
-	int nResult = 0, i;
-	unsigned char nCRCChkSum = 0;
-	unsigned char nBuf1[128];
-	struct TYCRC TCRCData;
+	int nResult = 0;
+	struct TYCRC sCRCData;
+	unsigned int i;
 
-	if ((nReg + len-1) > 127) {
+	if ((nReg + len - 1) > 127) {
 		nResult = -EINVAL;
 		dev_err(pTAS2557->dev, "firmware error\n");
 		goto end;
 	}
 
-	if ((nBook == TAS2557_BOOK_ID(TAS2557_SA_COEFF_SWAP_REG))
-		&& (nPage == TAS2557_PAGE_ID(TAS2557_SA_COEFF_SWAP_REG))
-		&& (nReg == TAS2557_PAGE_REG(TAS2557_SA_COEFF_SWAP_REG))
-		&& (len == 4)) {
-		/* DSP swap command, pass */
-		nResult = 0;
-		goto end;
-	}
+	for (i = 0; i < len; i++) {
+		/* DSP swap command, bypass */
+		if (isSwapReg(nBook, nPage, nReg + i))
+			continue;
 
-	nResult = isYRAM(pTAS2557, &TCRCData, nBook, nPage, nReg, len);
-	if (nResult == 1) {
-		if (len == 1) {
-			dev_err(pTAS2557->dev, "firmware error\n");
-			nResult = -EINVAL;
-			goto end;
-		} else {
-			nResult = pTAS2557->bulk_read(pTAS2557, TAS2557_REG(nBook, nPage, TCRCData.mnOffset), nBuf1, TCRCData.mnLen);
+		if (!isYRAM(pTAS2557, &sCRCData, nBook, nPage, nReg + i, 1))
+			continue;
+
+		if (pYPage->mbDirty
+			&& ((pYPage->mnBook != nBook)
+				|| (pYPage->mnPage != nPage)
+				|| pYPage->mpWritten[nReg + i])) {
+			nResult = doYRAMPageCheckSum(pTAS2557, pYPage, pCRCChkSum);
 			if (nResult < 0)
 				goto end;
+		}
 
-			for (i = 0; i < TCRCData.mnLen; i++) {
-				if ((nBook == TAS2557_BOOK_ID(TAS2557_SA_COEFF_SWAP_REG))
-					&& (nPage == TAS2557_PAGE_ID(TAS2557_SA_COEFF_SWAP_REG))
-					&& ((i + TCRCData.mnOffset)
-						>= TAS2557_PAGE_REG(TAS2557_SA_COEFF_SWAP_REG))
-					&& ((i + TCRCData.mnOffset)
-						<= (TAS2557_PAGE_REG(TAS2557_SA_COEFF_SWAP_REG) + 4))) {
-					/* DSP swap command, bypass */
-					continue;
-				} else
-					nCRCChkSum += ti_crc8(crc8_lookup_table, &nBuf1[i], 1, 0);
-			}
-
-			nResult = nCRCChkSum;
+		if (!pYPage->mbDirty) {
+			pYPage->mnBook = nBook;
+			pYPage->mnPage = nPage;
+			pYPage->mnStart = nReg + i;
+			pYPage->mnEnd = nReg + i;
+			pYPage->mbDirty = true;
 		}
+
+		if ((nReg + i) < pYPage->mnStart)
+			pYPage->mnStart = nReg + i;
+		if ((nReg + i) > pYPage->mnEnd)
+			pYPage->mnEnd = nReg + i;
+		pYPage->mpWritten[nReg + i] = 1;
+		pYPage->mpData[nReg + i] = pData[i];
 	}
 
 end:
@@ -1229,7 +2645,105 @@ end:
 	return nResult;
 }
 
-static int tas2557_load_block(struct tas2557_priv *pTAS2557, struct TBlock *pBlock)
+/*
+* a command may run inside a pending firmware delay only if all
+* it writes is YRAM coefficient memory, and not the swap command;
+* the delay itself must follow such writes only, see tas2557_load_block()
+*/
+static bool tas2557_delay_independent(struct tas2557_priv *pTAS2557, unsigned char *pCommand)
+{
+	struct TYCRC sCRCData;
+	unsigned char nBook = pCommand[0];
+	unsigned char nPage = pCommand[1];
+	unsigned char nOffset = pCommand[2];
+	unsigned int nLength = 1;
+
+	if (nOffset == 0x85) {
+		nLength = (nBook << 8) + nPage;
+		nBook = pCommand[4];
+		nPage = pCommand[5];
+		nOffset = pCommand[6];
+	} else if (nOffset > 0x7F)
+		return false;
+
+	if ((nLength == 0) || ((nOffset + nLength) > 128))
+		return false;
+
+	if (isSwapWrite(nBook, nPage, nOffset, nLength))
+		return false;
+
+	if (!isYRAM(pTAS2557, &sCRCData, nBook, nPage, nOffset, nLength))
+		return false;
+
+	return (sCRCData.mnOffset == nOffset) && (sCRCData.mnLen == nLength);
+}
+
+static void tas2557_delay_wait(ktime_t nDeadline)
+{
+	s64 nRemain = ktime_us_delta(nDeadline, ktime_get());
+
+	if (nRemain > 0)
+		tas2557_sleep_us(nRemain);
+}
+
+static unsigned int tas2557_get_verify_policy(struct tas2557_priv *pTAS2557)
+{
+	if (pTAS2557->mbVerifyEscalated)
+		return TAS2557_VERIFY_FULL;
+
+	return pTAS2557->mnVerifyPolicy;
+}
+
+/*
+* decide whether a burst is read back, pbAll is cleared once
+* a burst is skipped so the block checksum can't be compared
+*/
+static bool tas2557_verify_sample(struct tas2557_priv *pTAS2557,
+	unsigned int nPolicy, bool *pbAll)
+{
+	if (nPolicy != TAS2557_VERIFY_SAMPLED)
+		return true;
+
+	if ((prandom_u32() % 100) < pTAS2557->mnVerifySamplePct)
+		return true;
+
+	*pbAll = false;
+	return false;
+}
+
+int tas2557_set_verify_policy(struct tas2557_priv *pTAS2557,
+	unsigned int nPolicy, unsigned int nSamplePct)
+{
+	int nResult = 0;
+
+	if ((nPolicy >= TAS2557_VERIFY_MODES) || (nSamplePct > 100)) {
+		dev_err(pTAS2557->dev, "invalid verify policy %d, %d%%\n",
+			nPolicy, nSamplePct);
+		nResult = -EINVAL;
+		goto end;
+	}
+
+	pTAS2557->mnVerifyPolicy = nPolicy;
+	pTAS2557->mnVerifySamplePct = nSamplePct;
+	pTAS2557->mbVerifyEscalated = false;
+	dev_dbg(pTAS2557->dev, "verify policy %d, sample %d%%\n", nPolicy, nSamplePct);
+
+end:
+
+	return nResult;
+}
+
+/* the batched bursts go out before a delay, a CRC read or the block end */
+static int tas2557_batch_sync(struct tas2557_priv *pTAS2557)
+{
+	if (!pTAS2557->mbBatchOpen)
+		return 0;
+
+	return pTAS2557->batch_flush(pTAS2557);
+}
+
+/* one firmware block, called with fault_lock held */
+static int tas2557_do_load_block(struct tas2557_priv *pTAS2557, struct TBlock *pBlock)
 {
 	int nResult = 0;
 	unsigned int nCommand = 0;
@@ -1241,22 +2755,53 @@ static int tas2557_load_block(struct tas2557_priv *pTAS2557, struct TBlock *pBlo
 	unsigned int nSleep;
 	unsigned char nCRCChkSum = 0;
 	unsigned int nValue1;
-	int nRetry = 6;
+	int nSync;
+	int nRetry = TAS2557_BLOCK_RETRY_MAX;
 	unsigned char *pData = pBlock->mpData;
+	struct TYRAMPage sYPage;
+	struct TYRAMPage *pYPage = &sYPage;
+	unsigned int nPolicy = tas2557_get_verify_policy(pTAS2557);
+	struct TVerifyStats *pStats = &pTAS2557->mVerifyStats[nPolicy];
+	bool bPChkSum = pBlock->mbPChkSumPresent && (nPolicy != TAS2557_VERIFY_OFF);
+	bool bYChkSum = pBlock->mbYChkSumPresent
+		&& ((nPolicy == TAS2557_VERIFY_FULL) || (nPolicy == TAS2557_VERIFY_SAMPLED));
+	bool bYChkSumAll = true;
+	bool bDelayPending = false;
+	/* writes since the last delay, a delay is hoisted after YRAM writes only */
+	bool bYRAMWrite = false, bOtherWrite = false;
+	bool bIndependent;
+	ktime_t nDeadline = 0;
+	/* PRAM checksums cover every write, coefficient blocks only */
+	bool bDelta = pTAS2557->mbDeltaWrite && !pBlock->mbPChkSumPresent
+		&& (pBlock->mnType == TAS2557_BLOCK_CFG_COEFF_DEV_A);
 
 	dev_dbg(pTAS2557->dev, "TAS2557 load block: Type = %d, commands = %d\n",
 		pBlock->mnType, pBlock->mnCommands);
+	pStats->mnBlocks++;
+	pYPage->mnBytesRead = 0;
+	pTAS2557->mbBatchOpen = pTAS2557->mbBatchCapable;
 start:
-	if (pBlock->mbPChkSumPresent) {
+	if (bDelayPending) {
+		tas2557_delay_wait(nDeadline);
+		bDelayPending = false;
+	}
+
+	if (bPChkSum) {
 		nResult = pTAS2557->write(pTAS2557, TAS2557_CRC_RESET_REG, 1);
 		if (nResult < 0)
 			goto end;
 	}
 
-	if (pBlock->mbYChkSumPresent)
+	if (bYChkSum) {
 		nCRCChkSum = 0;
+		bYChkSumAll = true;
+		pYPage->mbDirty = false;
+		memset(pYPage->mpWritten, 0, sizeof(pYPage->mpWritten));
+	}
 
 	nCommand = 0;
+	bYRAMWrite = false;
+	bOtherWrite = false;
 
 	while (nCommand < pBlock->mnCommands) {
 		pData = pBlock->mpData + nCommand * 4;
@@ -1266,47 +2811,91 @@ start:
 		nOffset = pData[2];
 		nData = pData[3];
 
+		bIndependent = tas2557_delay_independent(pTAS2557, pData);
+		if (bDelayPending && !bIndependent) {
+			tas2557_delay_wait(nDeadline);
+			bDelayPending = false;
+		}
+
 		nCommand++;
 
+		if ((nOffset <= 0x7F) || (nOffset == 0x85)) {
+			if (bIndependent)
+				bYRAMWrite = true;
+			else
+				bOtherWrite = true;
+		}
+
 		if (nOffset <= 0x7F) {
-			nResult = pTAS2557->write(pTAS2557, TAS2557_REG(nBook, nPage, nOffset), nData);
+			/* the swap flips the banks, read back what was written before it */
+			if (bYChkSum && isSwapWrite(nBook, nPage, nOffset, 1)) {
+				nResult = doYRAMPageCheckSum(pTAS2557, pYPage, &nCRCChkSum);
+				if (nResult < 0)
+					goto yram_err;
+			}
+			nResult = tas2557_swap_hold(pTAS2557, pBlock, nBook, nPage, nOffset, &nData, 1);
+			if (nResult < 0)
+				goto end;
+			if (nResult > 0)
+				continue;
+			if (bDelta)
+				nResult = tas2557_write_delta(pTAS2557, nBook, nPage, nOffset, &nData, 1);
+			else
+				nResult = tas2557_write_burst(pTAS2557, nBook, nPage, nOffset, &nData, 1);
 			if (nResult < 0)
 				goto end;
-			if (pBlock->mbYChkSumPresent) {
-				nResult = doSingleRegCheckSum(pTAS2557, nBook, nPage, nOffset, nData);
+			if (bYChkSum && tas2557_verify_sample(pTAS2557, nPolicy, &bYChkSumAll)) {
+				pStats->mnBursts++;
+				nResult = doYRAMTrack(pTAS2557, pYPage,
+					nBook, nPage, nOffset, &nData, 1, &nCRCChkSum);
 				if (nResult < 0)
-					goto check;
-				nCRCChkSum += (unsigned char)nResult;
+					goto yram_err;
 			}
 		} else if (nOffset == 0x81) {
 			nSleep = (nBook << 8) + nPage;
-			msleep(nSleep);
+			nResult = tas2557_batch_sync(pTAS2557);
+			if (nResult < 0)
+				goto end;
+			/*
+			* a delay after a swap, power, PLL or clock write lets that
+			* settle, it is a hard barrier for everything that follows
+			*/
+			if (pTAS2557->mbDelayHoist && bYRAMWrite && !bOtherWrite) {
+				nDeadline = ktime_add_us(ktime_get(), nSleep * 1000);
+				bDelayPending = true;
+			} else
+				tas2557_sleep_us(nSleep * 1000);
+			bYRAMWrite = false;
+			bOtherWrite = false;
 		} else if (nOffset == 0x85) {
 			pData += 4;
 			nLength = (nBook << 8) + nPage;
 			nBook = pData[0];
 			nPage = pData[1];
 			nOffset = pData[2];
-			if (nLength > 1) {
-				nResult = pTAS2557->bulk_write(pTAS2557, TAS2557_REG(nBook, nPage, nOffset), pData + 3, nLength);
+			if (bYChkSum && isSwapWrite(nBook, nPage, nOffset, nLength)) {
+				nResult = doYRAMPageCheckSum(pTAS2557, pYPage, &nCRCChkSum);
 				if (nResult < 0)
-					goto end;
-				if (pBlock->mbYChkSumPresent) {
-					nResult = doMultiRegCheckSum(pTAS2557, nBook, nPage, nOffset, nLength);
-					if (nResult < 0)
-						goto check;
-					nCRCChkSum += (unsigned char)nResult;
-				}
-			} else {
-				nResult = pTAS2557->write(pTAS2557, TAS2557_REG(nBook, nPage, nOffset), pData[3]);
+					goto yram_err;
+			}
+			nResult = tas2557_swap_hold(pTAS2557, pBlock, nBook, nPage, nOffset, pData + 3, nLength);
+			if (nResult > 0)
+				nResult = 0;
+			else if (nResult < 0)
+				goto end;
+			else if (bDelta)
+				nResult = tas2557_write_delta(pTAS2557,
+					nBook, nPage, nOffset, pData + 3, nLength);
+			else
+				nResult = tas2557_write_burst(pTAS2557, nBook, nPage, nOffset, pData + 3, nLength);
+			if (nResult < 0)
+				goto end;
+			if (bYChkSum && tas2557_verify_sample(pTAS2557, nPolicy, &bYChkSumAll)) {
+				pStats->mnBursts++;
+				nResult = doYRAMTrack(pTAS2557, pYPage,
+					nBook, nPage, nOffset, pData + 3, nLength, &nCRCChkSum);
 				if (nResult < 0)
-					goto end;
-				if (pBlock->mbYChkSumPresent) {
-					nResult = doSingleRegCheckSum(pTAS2557, nBook, nPage, nOffset, pData[3]);
-					if (nResult < 0)
-						goto check;
-					nCRCChkSum += (unsigned char)nResult;
-				}
+					goto yram_err;
 			}
 
 			nCommand++;
@@ -1315,51 +2904,101 @@ start:
 				nCommand += ((nLength - 2) / 4) + 1;
 		}
 	}
-	if (pBlock->mbPChkSumPresent) {
+
+	nResult = tas2557_batch_sync(pTAS2557);
+	if (nResult < 0)
+		goto end;
+
+	if (bDelayPending) {
+		tas2557_delay_wait(nDeadline);
+		bDelayPending = false;
+	}
+
+	if (bPChkSum) {
 		nResult = pTAS2557->read(pTAS2557, TAS2557_CRC_CHECKSUM_REG, &nValue1);
 		if (nResult < 0)
 			goto end;
+		pStats->mnBytesRead++;
 		if ((nValue1&0xff) != pBlock->mnPChkSum) {
 			dev_err(pTAS2557->dev, "Block PChkSum Error: FW = 0x%x, Reg = 0x%x\n",
 				pBlock->mnPChkSum, (nValue1&0xff));
 			nResult = -EAGAIN;
-				pTAS2557->mnErrCode |= ERROR_PRAM_CRCCHK;
-			goto check;
+			tas2557_update_error(pTAS2557, ERROR_PRAM_CRCCHK, ERROR_PRAM_CRCCHK);
+			pStats->mnPRAMErrors++;
+			/* PRAM CRC covers the whole block, only a full reload can fix it */
+			nRetry--;
+			if (nRetry > 0)
+				goto start;
+			goto end;
 		}
 
 		nResult = 0;
-		pTAS2557->mnErrCode &= ~ERROR_PRAM_CRCCHK;
+		tas2557_update_error(pTAS2557, ERROR_PRAM_CRCCHK, 0);
 		dev_dbg(pTAS2557->dev, "Block[0x%x] PChkSum match\n", pBlock->mnType);
 	}
 
-	if (pBlock->mbYChkSumPresent) {
+	if (bYChkSum) {
+		nResult = doYRAMPageCheckSum(pTAS2557, pYPage, &nCRCChkSum);
+		if (nResult < 0)
+			goto yram_err;
+
+		/* a sampled download only covers part of the block checksum */
+		if (!bYChkSumAll)
+			goto end;
+
+		/* every byte has been read back already, reloading can't change the sum */
 		if (nCRCChkSum != pBlock->mnYChkSum) {
 			dev_err(pTAS2557->dev, "Block YChkSum Error: FW = 0x%x, YCRC = 0x%x\n",
 				pBlock->mnYChkSum, nCRCChkSum);
 			nResult = -EAGAIN;
-			pTAS2557->mnErrCode |= ERROR_YRAM_CRCCHK;
-			goto check;
+			goto yram_err;
 		}
-		pTAS2557->mnErrCode &= ~ERROR_YRAM_CRCCHK;
+		tas2557_update_error(pTAS2557, ERROR_YRAM_CRCCHK, 0);
 		nResult = 0;
 		dev_dbg(pTAS2557->dev, "Block[0x%x] YChkSum match\n", pBlock->mnType);
 	}
 
-check:
+	goto end;
+
+yram_err:
 	if (nResult == -EAGAIN) {
-		nRetry--;
-		if (nRetry > 0)
-			goto start;
+		tas2557_update_error(pTAS2557, ERROR_YRAM_CRCCHK, ERROR_YRAM_CRCCHK);
+		pStats->mnYRAMErrors++;
 	}
 
 end:
+	/* an error exit may leave bursts queued, they still go out in order */
+	nSync = tas2557_batch_sync(pTAS2557);
+	if ((nResult >= 0) && (nSync < 0))
+		nResult = nSync;
+	pTAS2557->mbBatchOpen = false;
+	pStats->mnBytesRead += pYPage->mnBytesRead;
 	if (nResult < 0) {
 		dev_err(pTAS2557->dev, "Block (%d) load error\n",
 				pBlock->mnType);
+		if (!pTAS2557->mbVerifyEscalated && (nPolicy != TAS2557_VERIFY_FULL)) {
+			dev_warn(pTAS2557->dev, "escalate to full verification\n");
+			pTAS2557->mbVerifyEscalated = true;
+			pStats->mnEscalations++;
+			/* the failing block is loaded again under the full policy */
+			return tas2557_do_load_block(pTAS2557, pBlock);
+		}
 	}
 	return nResult;
 }
 
+/* a fault shutdown from the IRQ thread waits for the block to finish */
+static int tas2557_load_block(struct tas2557_priv *pTAS2557, struct TBlock *pBlock)
+{
+	int nResult;
+
+	mutex_lock(&pTAS2557->fault_lock);
+	nResult = tas2557_do_load_block(pTAS2557, pBlock);
+	mutex_unlock(&pTAS2557->fault_lock);
+
+	return nResult;
+}
+
 static int tas2557_load_data(struct tas2557_priv *pTAS2557, struct TData *pData, unsigned int nType)
 {
 	int nResult = 0;
@@ -1435,15 +3074,19 @@ static int tas2557_load_configuration(struct tas2557_priv *pTAS2557,
 		pTAS2557->mbLoadConfigurationPrePowerUp = false;
 		nResult = tas2557_load_coefficient(pTAS2557, pTAS2557->mnCurrentConfiguration, nConfiguration, true);
 	} else {
+		nResult = tas2557_standby_off(pTAS2557);
+		if (nResult < 0)
+			goto end;
 		dev_dbg(pTAS2557->dev,
-			"TAS2557 was powered down, will load coefficient when power up\n");
+			"TAS2557 was powered down, preload coefficient before power up\n");
 		pTAS2557->mbLoadConfigurationPrePowerUp = true;
 		pTAS2557->mnNewConfiguration = nConfiguration;
+		tas2557_preload_queue(pTAS2557);
 	}
 
 end:
 
-	if (nResult < 0) {
+	if ((nResult < 0) && (nResult != -ECANCELED)) {
 		if (pTAS2557->mnErrCode & (ERROR_DEVA_I2C_COMM | ERROR_PRAM_CRCCHK | ERROR_YRAM_CRCCHK))
 			failsafe(pTAS2557);
 	}
@@ -1516,9 +3159,12 @@ void tas2557_clear_firmware(struct TFirmware *pFirmware)
 			for (nn = 0; nn < pFirmware->mpPrograms[n].mData.mnBlocks; nn++)
 				kfree(pFirmware->mpPrograms[n].mData.mpBlocks[nn].mpData);
 			kfree(pFirmware->mpPrograms[n].mData.mpBlocks);
+			kfree(pFirmware->mpPrograms[n].mData.mpCoeffIndex);
+			kfree(pFirmware->mpPrograms[n].mImage.mpEntries);
 		}
 		kfree(pFirmware->mpPrograms);
 	}
+	kfree(pFirmware->mpProgramSwitch);
 
 	if (pFirmware->mpConfigurations != NULL) {
 		for (n = 0; n < pFirmware->mnConfigurations; n++) {
@@ -1527,6 +3173,8 @@ void tas2557_clear_firmware(struct TFirmware *pFirmware)
 			for (nn = 0; nn < pFirmware->mpConfigurations[n].mData.mnBlocks; nn++)
 				kfree(pFirmware->mpConfigurations[n].mData.mpBlocks[nn].mpData);
 			kfree(pFirmware->mpConfigurations[n].mData.mpBlocks);
+			kfree(pFirmware->mpConfigurations[n].mData.mpCoeffIndex);
+			kfree(pFirmware->mpConfigurations[n].mRegs.mpEntries);
 		}
 		kfree(pFirmware->mpConfigurations);
 	}
@@ -1538,6 +3186,7 @@ void tas2557_clear_firmware(struct TFirmware *pFirmware)
 			for (nn = 0; nn < pFirmware->mpCalibrations[n].mData.mnBlocks; nn++)
 				kfree(pFirmware->mpCalibrations[n].mData.mpBlocks[nn].mpData);
 			kfree(pFirmware->mpCalibrations[n].mData.mpBlocks);
+			kfree(pFirmware->mpCalibrations[n].mData.mpCoeffIndex);
 		}
 		kfree(pFirmware->mpCalibrations);
 	}
@@ -1545,55 +3194,72 @@ void tas2557_clear_firmware(struct TFirmware *pFirmware)
 	memset(pFirmware, 0x00, sizeof(struct TFirmware));
 }
 
-static int tas2557_load_calibration(struct tas2557_priv *pTAS2557,	char *pFileName)
+/*
+* calibration file from the firmware search path, parsed once; the file
+* image is kept so a calibration dropped after a load error is parsed
+* again without touching the filesystem
+*/
+static int tas2557_load_calibration(struct tas2557_priv *pTAS2557, char *pFileName)
 {
+	const struct firmware *pFW = NULL;
+	unsigned char *pImage;
 	int nResult = 0;
-/*
-*	int nFile;
-*	mm_segment_t fs;
-*	unsigned char pBuffer[1000];
-*	int nSize = 0;
-*
-*	dev_dbg(pTAS2557->dev, "%s:\n", __func__);
-*
-*	fs = get_fs();
-*	set_fs(KERNEL_DS);
-*	nFile = sys_open(pFileName, O_RDONLY, 0);
-*
-*	dev_info(pTAS2557->dev, "TAS2557 calibration file = %s, handle = %d\n",
-*		pFileName, nFile);
-*
-*	if (nFile >= 0) {
-*		nSize = sys_read(nFile, pBuffer, 1000);
-*		sys_close(nFile);
-*	} else {
-*		dev_err(pTAS2557->dev, "TAS2557 cannot open calibration file: %s\n",
-*			pFileName);
-*	}
-*
-*	set_fs(fs);
-*
-*	if (!nSize)
-*		goto end;
-*
-*	tas2557_clear_firmware(pTAS2557->mpCalFirmware);
-*	dev_info(pTAS2557->dev, "TAS2557 calibration file size = %d\n", nSize);
-*	nResult = fw_parse(pTAS2557, pTAS2557->mpCalFirmware, pBuffer, nSize);
-*
-*	if (nResult)
-*		dev_err(pTAS2557->dev, "TAS2557 calibration file is corrupt\n");
-*	else
-*		dev_info(pTAS2557->dev, "TAS2557 calibration: %d calibrations\n",
-*			pTAS2557->mpCalFirmware->mnCalibrations);
-*
-*end:
-**/
-	return nResult;
-}
 
-static bool tas2557_get_coefficient_in_block(struct tas2557_priv *pTAS2557,
-	struct TBlock *pBlock, int nReg, int *pnValue)
-{
+	if (pTAS2557->mpCalImage && pTAS2557->mpCalFirmware->mnCalibrations) {
+		dev_dbg(pTAS2557->dev, "%s, %s cached\n", __func__, pFileName);
+		goto end;
+	}
+
+	if (!pTAS2557->mpCalImage) {
+		nResult = request_firmware(&pFW, pFileName, pTAS2557->dev);
+		if (nResult < 0) {
+			dev_err(pTAS2557->dev, "TAS2557 cannot load calibration file: %s\n",
+				pFileName);
+			goto end;
+		}
+
+		pImage = kmemdup(pFW->data, pFW->size, GFP_KERNEL);
+		pTAS2557->mnCalImageSize = pFW->size;
+		release_firmware(pFW);
+		if (!pImage) {
+			nResult = -ENOMEM;
+			goto end;
+		}
+		pTAS2557->mpCalImage = pImage;
+		dev_info(pTAS2557->dev, "TAS2557 calibration file size = %d\n",
+			pTAS2557->mnCalImageSize);
+	}
+
+	tas2557_clear_firmware(pTAS2557->mpCalFirmware);
+	nResult = fw_parse(pTAS2557, pTAS2557->mpCalFirmware,
+		pTAS2557->mpCalImage, pTAS2557->mnCalImageSize);
+	if ((nResult < 0) || !pTAS2557->mpCalFirmware->mnCalibrations) {
+		dev_err(pTAS2557->dev, "TAS2557 calibration file is corrupt\n");
+		tas2557_clear_firmware(pTAS2557->mpCalFirmware);
+		tas2557_calibration_free(pTAS2557);
+		nResult = -EINVAL;
+		goto end;
+	}
+
+	dev_info(pTAS2557->dev, "TAS2557 calibration: %d calibrations\n",
+		pTAS2557->mpCalFirmware->mnCalibrations);
+
+end:
+
+	return nResult;
+}
+
+/* the parsed calibration stays, the next 0xFF request reads the file again */
+void tas2557_calibration_free(struct tas2557_priv *pTAS2557)
+{
+	kfree(pTAS2557->mpCalImage);
+	pTAS2557->mpCalImage = NULL;
+	pTAS2557->mnCalImageSize = 0;
+}
+
+static bool tas2557_get_coefficient_in_block(struct tas2557_priv *pTAS2557,
+	struct TBlock *pBlock, int nReg, int *pnValue)
+{
 	int nCoefficient = 0;
 	bool bFound = false;
 	unsigned char *pCommands;
@@ -1647,6 +3313,33 @@ static bool tas2557_get_coefficient_in_block(struct tas2557_priv *pTAS2557,
 	return bFound;
 }
 
+static bool tas2557_get_coefficient_in_index(struct tas2557_priv *pTAS2557,
+	struct TData *pData, int nReg, int *pnValue)
+{
+	struct TCoeffEntry *pEntry;
+	unsigned char *pWord;
+	unsigned int nKey = nReg + 1;
+	unsigned int nSlot;
+
+	nSlot = jhash_1word(nKey, 0) & (pData->mnCoeffSlots - 1);
+	pEntry = &(pData->mpCoeffIndex[nSlot]);
+	while (pEntry->mnReg != nKey) {
+		if (!pEntry->mnReg)
+			return false;
+		nSlot = (nSlot + 1) & (pData->mnCoeffSlots - 1);
+		pEntry = &(pData->mpCoeffIndex[nSlot]);
+	}
+
+	pWord = pData->mpBlocks[pEntry->mnBlock].mpData + pEntry->mnOffset;
+	*pnValue = ((int)pWord[0] << 24) | ((int)pWord[1] << 16)
+		| ((int)pWord[2] << 8) | (int)pWord[3];
+	dev_dbg(pTAS2557->dev, "%s, B[0x%x]P[0x%x]R[0x%x]=0x%x\n", __func__,
+		TAS2557_BOOK_ID(nReg), TAS2557_PAGE_ID(nReg), TAS2557_PAGE_REG(nReg),
+		*pnValue);
+
+	return true;
+}
+
 static bool tas2557_get_coefficient_in_data(struct tas2557_priv *pTAS2557,
 	struct TData *pData, int blockType, int nReg, int *pnValue)
 {
@@ -1654,6 +3347,11 @@ static bool tas2557_get_coefficient_in_data(struct tas2557_priv *pTAS2557,
 	struct TBlock *pBlock;
 	int i;
 
+	/* the index holds every word aligned coefficient of these blocks */
+	if ((blockType == TAS2557_BLOCK_CFG_COEFF_DEV_A) && pData->mpCoeffIndex
+		&& !(TAS2557_PAGE_REG(nReg) & 0x03))
+		return tas2557_get_coefficient_in_index(pTAS2557, pData, nReg, pnValue);
+
 	for (i = 0; i < pData->mnBlocks; i++) {
 		pBlock = &(pData->mpBlocks[i]);
 		if (pBlock->mnType == blockType) {
@@ -1667,6 +3365,42 @@ static bool tas2557_get_coefficient_in_data(struct tas2557_priv *pTAS2557,
 	return bFound;
 }
 
+/*
+* coefficient the firmware writes to nReg in a program, configuration
+* or calibration, for the misc debug interface
+*/
+bool tas2557_get_fw_coefficient(struct tas2557_priv *pTAS2557,
+	unsigned int nDataType, unsigned int nIndex, int nReg, int *pnValue)
+{
+	struct TFirmware *pFirmware = pTAS2557->mpFirmware;
+	struct TData *pData = NULL;
+
+	switch (nDataType) {
+	case TAS2557_FW_DATA_PROGRAM:
+		if (nIndex < pFirmware->mnPrograms)
+			pData = &(pFirmware->mpPrograms[nIndex].mData);
+		break;
+	case TAS2557_FW_DATA_CONFIGURATION:
+		if (nIndex < pFirmware->mnConfigurations)
+			pData = &(pFirmware->mpConfigurations[nIndex].mData);
+		break;
+	case TAS2557_FW_DATA_CALIBRATION:
+		pFirmware = pTAS2557->mpCalFirmware;
+		if (nIndex < pFirmware->mnCalibrations)
+			pData = &(pFirmware->mpCalibrations[nIndex].mData);
+		break;
+	}
+
+	if (!pData) {
+		dev_err(pTAS2557->dev, "%s, no data %d[%d]\n", __func__,
+			nDataType, nIndex);
+		return false;
+	}
+
+	return tas2557_get_coefficient_in_data(pTAS2557, pData,
+		TAS2557_BLOCK_CFG_COEFF_DEV_A, nReg, pnValue);
+}
+
 static bool tas2557_find_Tmax_in_configuration(struct tas2557_priv *pTAS2557,
 	struct TConfiguration *pConfiguration, int *pnTMax)
 {
@@ -1718,6 +3452,8 @@ void tas2557_fw_ready(const struct firmware *pFW, void *pContext)
 		dev_dbg(pTAS2557->dev, "clear current firmware\n");
 		tas2557_clear_firmware(pTAS2557->mpFirmware);
 	}
+	/* history indexes the old configurations */
+	tas2557_prefetch_free(pTAS2557);
 
 	nResult = fw_parse(pTAS2557, pTAS2557->mpFirmware, (unsigned char *)(pFW->data), pFW->size);
 	release_firmware(pFW);
@@ -1745,6 +3481,7 @@ void tas2557_fw_ready(const struct firmware *pFW, void *pContext)
 	}
 
 	pTAS2557->mnCurrentSampleRate = nSampleRate;
+	pTAS2557->mbResetRequired = true;
 	nResult = tas2557_set_program(pTAS2557, nProgram, -1);
 
 end:
@@ -1756,6 +3493,105 @@ end:
 #ifdef CONFIG_TAS2557_MISC
 	mutex_unlock(&pTAS2557->file_lock);
 #endif
+
+	/* reference taken by whoever requested the firmware */
+	tas2557_pm_put(pTAS2557);
+}
+
+/*
+* bring the running registers to the image of a program, consecutive
+* registers of a page go out as one run and only the bytes that differ
+* from the shadow are written; with pnBytes nothing is written, the bus
+* bytes the load would take are added to *pnBytes instead
+*/
+static int tas2557_program_image_walk(struct tas2557_priv *pTAS2557,
+	struct TProgram *pProgram, unsigned int *pnBytes)
+{
+	struct TRegImage *pImage = &(pProgram->mImage);
+	unsigned char pBuf[128];
+	unsigned int i, nReg, nLength = 0;
+	unsigned int nStart = 0;
+	int nResult = 0;
+
+	for (i = 0; i <= pImage->mnRegs; i++) {
+		if (nLength) {
+			nReg = (i < pImage->mnRegs) ? (pImage->mpEntries[i] >> 8) : 0;
+			if ((i == pImage->mnRegs)
+				|| (nReg != (nStart + nLength))
+				|| (TAS2557_PAGE_REG(nReg) == 0)) {
+				if (pnBytes)
+					*pnBytes += tas2557_delta_bytes(pTAS2557,
+						TAS2557_BOOK_ID(nStart), TAS2557_PAGE_ID(nStart),
+						TAS2557_PAGE_REG(nStart), pBuf, nLength);
+				else
+					nResult = tas2557_write_delta(pTAS2557,
+						TAS2557_BOOK_ID(nStart), TAS2557_PAGE_ID(nStart),
+						TAS2557_PAGE_REG(nStart), pBuf, nLength);
+				if (nResult < 0)
+					goto end;
+				nLength = 0;
+			}
+		}
+
+		if (i == pImage->mnRegs)
+			break;
+		if (!nLength)
+			nStart = pImage->mpEntries[i] >> 8;
+		pBuf[nLength++] = pImage->mpEntries[i] & 0xff;
+	}
+
+end:
+
+	return nResult;
+}
+
+static int tas2557_load_program_image(struct tas2557_priv *pTAS2557, struct TProgram *pProgram)
+{
+	int nResult;
+
+	mutex_lock(&pTAS2557->fault_lock);
+	nResult = tas2557_program_image_walk(pTAS2557, pProgram, NULL);
+	mutex_unlock(&pTAS2557->fault_lock);
+
+	return nResult;
+}
+
+/*
+* a program switch skips the reset only if nothing the outgoing
+* program, configuration or calibration wrote can survive it: the
+* incoming program must rewrite the old program's registers, and the
+* incoming program and configuration together the old configuration's
+*/
+static bool tas2557_program_incremental(struct tas2557_priv *pTAS2557,
+	unsigned int nProgram, unsigned int nConfiguration)
+{
+	struct TFirmware *pFirmware = pTAS2557->mpFirmware;
+	struct TConfiguration *pFrom, *pTo;
+
+	if (pTAS2557->mbResetRequired || !pFirmware->mpProgramSwitch)
+		return false;
+	if ((pTAS2557->mnCurrentProgram >= pFirmware->mnPrograms)
+		|| (pTAS2557->mnCurrentConfiguration >= pFirmware->mnConfigurations)
+		|| (nConfiguration >= pFirmware->mnConfigurations))
+		return false;
+	if (pFirmware->mpProgramSwitch[pTAS2557->mnCurrentProgram * pFirmware->mnPrograms + nProgram]
+		!= TAS2557_SWITCH_INCREMENTAL)
+		return false;
+
+	/* staged and calibration coefficients aren't tracked, a reset clears them */
+	if (pTAS2557->mnStagedConfiguration >= 0)
+		return false;
+	if (pTAS2557->mpCalFirmware->mnCalibrations
+		&& (pFirmware->mpPrograms[pTAS2557->mnCurrentProgram].mnAppMode == TAS2557_APP_TUNINGMODE))
+		return false;
+
+	pFrom = &(pFirmware->mpConfigurations[pTAS2557->mnCurrentConfiguration]);
+	pTo = &(pFirmware->mpConfigurations[nConfiguration]);
+	if (!pFrom->mbRegsTracked)
+		return false;
+
+	return fw_image_covers(&(pFrom->mRegs), &(pFirmware->mpPrograms[nProgram].mImage),
+		pTo->mbRegsTracked ? &(pTo->mRegs) : NULL);
 }
 
 int tas2557_set_program(struct tas2557_priv *pTAS2557,
@@ -1766,6 +3602,7 @@ int tas2557_set_program(struct tas2557_priv *pTAS2557,
 	unsigned int nSampleRate = 0;
 	unsigned char nGain;
 	bool bFound = false;
+	bool bIncremental;
 	int nResult = 0;
 
 	if ((!pTAS2557->mpFirmware->mpPrograms) ||
@@ -1817,6 +3654,13 @@ int tas2557_set_program(struct tas2557_priv *pTAS2557,
 	}
 
 	pProgram = &(pTAS2557->mpFirmware->mpPrograms[nProgram]);
+	bIncremental = tas2557_program_incremental(pTAS2557, nProgram, nConfiguration);
+	/* the program load rewrites the staged bank */
+	tas2557_prefetch_drop(pTAS2557);
+	nResult = tas2557_standby_off(pTAS2557);
+	if (nResult < 0)
+		goto end;
+
 	if (pTAS2557->mbPowerUp) {
 		dev_info(pTAS2557->dev,
 			"device powered up, power down to load program %d (%s)\n",
@@ -1832,19 +3676,43 @@ int tas2557_set_program(struct tas2557_priv *pTAS2557,
 			goto end;
 	}
 
-	pTAS2557->hw_reset(pTAS2557);
-	nResult = pTAS2557->write(pTAS2557, TAS2557_SW_RESET_REG, 0x01);
-	if (nResult < 0)
-		goto end;
-	msleep(1);
-	nResult = tas2557_load_default(pTAS2557);
-	if (nResult < 0)
+	if (tas2557_load_superseded(pTAS2557)) {
+		nResult = -ECANCELED;
 		goto end;
+	}
 
-	dev_info(pTAS2557->dev, "load program %d (%s)\n", nProgram, pProgram->mpName);
-	nResult = tas2557_load_data(pTAS2557, &(pProgram->mData), TAS2557_BLOCK_PGM_DEV_A);
-	if (nResult < 0)
-		goto end;
+	if (bIncremental) {
+		pTAS2557->mbResetRequired = true;
+		nResult = tas2557_load_default(pTAS2557);
+		if (nResult < 0)
+			goto end;
+
+		dev_info(pTAS2557->dev, "switch program %d -> %d (%s) without reset\n",
+			pTAS2557->mnCurrentProgram, nProgram, pProgram->mpName);
+		nResult = tas2557_load_program_image(pTAS2557, pProgram);
+		if (nResult < 0)
+			goto end;
+	} else {
+		pTAS2557->mbResetRequired = true;
+		pTAS2557->hw_reset(pTAS2557);
+		nResult = pTAS2557->write(pTAS2557, TAS2557_SW_RESET_REG, 0x01);
+		if (nResult < 0)
+			goto end;
+		tas2557_sleep_us(TAS2557_SW_RESET_US);
+		nResult = tas2557_load_default(pTAS2557);
+		if (nResult < 0)
+			goto end;
+
+		if (tas2557_load_superseded(pTAS2557)) {
+			nResult = -ECANCELED;
+			goto end;
+		}
+
+		dev_info(pTAS2557->dev, "load program %d (%s)\n", nProgram, pProgram->mpName);
+		nResult = tas2557_load_data(pTAS2557, &(pProgram->mData), TAS2557_BLOCK_PGM_DEV_A);
+		if (nResult < 0)
+			goto end;
+	}
 	pTAS2557->mnCurrentProgram = nProgram;
 
 	nResult = tas2557_get_DAC_gain(pTAS2557, &nGain);
@@ -1856,6 +3724,7 @@ int tas2557_set_program(struct tas2557_priv *pTAS2557,
 	nResult = tas2557_load_coefficient(pTAS2557, -1, nConfiguration, false);
 	if (nResult < 0)
 		goto end;
+	pTAS2557->mbResetRequired = false;
 
 	if (pTAS2557->mbPowerUp) {
 		pTAS2557->clearIRQ(pTAS2557);
@@ -1868,11 +3737,12 @@ int tas2557_set_program(struct tas2557_priv *pTAS2557,
 			if (nResult < 0) {
 				nResult = tas2557_dev_load_data(pTAS2557, p_tas2557_shutdown_data);
 				pTAS2557->mbPowerUp = false;
+				tas2557_power_ref(pTAS2557, false);
 				goto end;
 			}
 		}
 		dev_dbg(pTAS2557->dev, "device powered up, load unmute\n");
-		nResult = tas2557_dev_load_data(pTAS2557, p_tas2557_unmute_data);
+		nResult = tas2557_load_mute(pTAS2557);
 		if (nResult < 0)
 			goto end;
 
@@ -1884,24 +3754,103 @@ int tas2557_set_program(struct tas2557_priv *pTAS2557,
 					ns_to_ktime((u64)LOW_TEMPERATURE_CHECK_PERIOD * NSEC_PER_MSEC), HRTIMER_MODE_REL);
 			}
 		}
+		tas2557_post_queue(pTAS2557, true);
 	}
 
 end:
 
-	if (nResult < 0) {
+	if ((nResult < 0) && (nResult != -ECANCELED)) {
 		if (pTAS2557->mnErrCode & (ERROR_DEVA_I2C_COMM | ERROR_PRAM_CRCCHK | ERROR_YRAM_CRCCHK))
 			failsafe(pTAS2557);
 	}
 	return nResult;
 }
 
+/*
+* queue a program and/or configuration request, called before taking
+* codec_lock so that a load in flight sees it at its next stage;
+* requests are merged, the last program and the last configuration win
+*/
+void tas2557_post_load(struct tas2557_priv *pTAS2557, int nProgram, int nConfig)
+{
+	struct TLoadRequest *pRequest = &pTAS2557->mLoadRequest;
+
+	spin_lock(&pTAS2557->mLoadLock);
+
+	if (nProgram != TAS2557_LOAD_UNCHANGED) {
+		pRequest->mnProgram = nProgram;
+		pRequest->mnConfiguration = nConfig;
+	} else {
+		/* a configuration posted after a program belongs to that program */
+		if (!pRequest->mbPending)
+			pRequest->mnProgram = TAS2557_LOAD_UNCHANGED;
+		pRequest->mnConfiguration = nConfig;
+	}
+	pRequest->mbPending = true;
+	pRequest->mnSeq++;
+	if (!pRequest->mnSeq)
+		pRequest->mnSeq++;
+
+	spin_unlock(&pTAS2557->mLoadLock);
+}
+
+/*
+* run the pending request, the caller must hold codec_lock and file_lock;
+* a request that has been applied by another caller is a no-op and a load
+* stopped for a newer request returns -ECANCELED
+*/
+int tas2557_apply_load(struct tas2557_priv *pTAS2557)
+{
+	struct TLoadRequest sRequest;
+	int nResult = 0;
+
+	spin_lock(&pTAS2557->mLoadLock);
+	sRequest = pTAS2557->mLoadRequest;
+	pTAS2557->mLoadRequest.mbPending = false;
+	pTAS2557->mnLoadSeq = sRequest.mnSeq;
+	spin_unlock(&pTAS2557->mLoadLock);
+
+	if (!sRequest.mbPending)
+		goto end;
+
+	/* after an interrupted load only a full program load is trusted */
+	if ((sRequest.mnProgram == TAS2557_LOAD_UNCHANGED) && pTAS2557->mbResetRequired)
+		sRequest.mnProgram = pTAS2557->mnCurrentProgram;
+
+	if (sRequest.mnProgram != TAS2557_LOAD_UNCHANGED) {
+		if (sRequest.mnConfiguration == TAS2557_LOAD_KEEP_CONFIG) {
+			if (sRequest.mnProgram == pTAS2557->mnCurrentProgram)
+				sRequest.mnConfiguration = pTAS2557->mnCurrentConfiguration;
+			else
+				sRequest.mnConfiguration = -1;
+		}
+		nResult = tas2557_set_program(pTAS2557, sRequest.mnProgram, sRequest.mnConfiguration);
+	} else
+		nResult = tas2557_set_config(pTAS2557, sRequest.mnConfiguration);
+
+	if (nResult == -ECANCELED) {
+		pTAS2557->mbResetRequired = true;
+		spin_lock(&pTAS2557->mLoadLock);
+		if (pTAS2557->mLoadRequest.mnProgram == TAS2557_LOAD_UNCHANGED)
+			pTAS2557->mLoadRequest.mnProgram = sRequest.mnProgram;
+		spin_unlock(&pTAS2557->mLoadLock);
+	}
+
+end:
+	pTAS2557->mnLoadSeq = 0;
+
+	return nResult;
+}
+
 int tas2557_set_calibration(struct tas2557_priv *pTAS2557, int nCalibration)
 {
 	struct TCalibration *pCalibration = NULL;
 	struct TConfiguration *pConfiguration;
 	struct TProgram *pProgram;
+	unsigned int nDepth;
 	int nTmax = 0;
 	bool bFound = false;
+	bool bLive = false;
 	int nResult = 0;
 
 	if ((!pTAS2557->mpFirmware->mpPrograms)
@@ -1912,11 +3861,12 @@ int tas2557_set_calibration(struct tas2557_priv *pTAS2557, int nCalibration)
 	}
 
 	if (nCalibration == 0x00FF) {
-		nResult = tas2557_load_calibration(pTAS2557, TAS2557_CAL_NAME);
+		nResult = tas2557_load_calibration(pTAS2557, pTAS2557->mpCalName);
 		if (nResult < 0) {
 			dev_info(pTAS2557->dev, "load new calibration file %s fail %d\n",
-				TAS2557_CAL_NAME, nResult);
-			goto end;
+				pTAS2557->mpCalName, nResult);
+			/* nothing written, the device keeps its calibration */
+			return nResult;
 		}
 		nCalibration = 0;
 	}
@@ -1946,7 +3896,21 @@ int tas2557_set_calibration(struct tas2557_priv *pTAS2557, int nCalibration)
 		}
 
 		dev_dbg(pTAS2557->dev, "%s, load calibration\n", __func__);
+		/* its swap would activate a staged configuration */
+		nResult = tas2557_prefetch_unstage(pTAS2557);
+		if (nResult < 0)
+			goto end;
+		if (pTAS2557->mbPowerUp) {
+			tas2557_swap_begin(pTAS2557);
+			bLive = true;
+		}
 		nResult = tas2557_load_data(pTAS2557, &(pCalibration->mData), TAS2557_BLOCK_CFG_COEFF_DEV_A);
+		if (bLive) {
+			if (nResult < 0)
+				tas2557_swap_commit(pTAS2557, false);
+			else
+				nResult = tas2557_swap_commit(pTAS2557, true);
+		}
 		if (nResult < 0)
 			goto end;
 	}
@@ -1954,83 +3918,1221 @@ int tas2557_set_calibration(struct tas2557_priv *pTAS2557, int nCalibration)
 end:
 	if (nResult < 0) {
 		tas2557_clear_firmware(pTAS2557->mpCalFirmware);
+		/*
+		* the reload writes its swaps through, a swap held by the caller
+		* is dropped and the caller's commit finds nothing left to write
+		*/
+		nDepth = pTAS2557->mnSwapDepth;
+		pTAS2557->mnSwapDepth = 0;
+		pTAS2557->mbSwapPending = false;
+		pTAS2557->mbResetRequired = true;
 		nResult = tas2557_set_program(pTAS2557, pTAS2557->mnCurrentProgram, pTAS2557->mnCurrentConfiguration);
+		pTAS2557->mnSwapDepth = nDepth;
 	}
 
 	return nResult;
 }
 
-bool tas2557_get_Cali_prm_r0(struct tas2557_priv *pTAS2557, int *prm_r0)
+/* configuration waiting for power up counts as the current one */
+static unsigned int tas2557_target_configuration(struct tas2557_priv *pTAS2557)
 {
-	struct TCalibration *pCalibration;
-	struct TData *pData;
-	int nReg;
-	int nCali_Re;
-	bool bFound = false;
-	int nBlockType;
+	if (pTAS2557->mbLoadConfigurationPrePowerUp)
+		return pTAS2557->mnNewConfiguration;
 
-	if (!pTAS2557->mpCalFirmware->mnCalibrations) {
-		dev_err(pTAS2557->dev, "%s, no calibration data\n", __func__);
+	return pTAS2557->mnCurrentConfiguration;
+}
+
+void tas2557_get_profile(struct tas2557_priv *pTAS2557, struct TProfile *pProfile)
+{
+	unsigned char nBitRate = 0;
+
+	pProfile->mnProgram = pTAS2557->mnCurrentProgram;
+	pProfile->mnConfiguration = tas2557_target_configuration(pTAS2557);
+	pProfile->mnCalibration = pTAS2557->mnCurrentCalibration;
+	pProfile->mnSamplingRate = pTAS2557->mnCurrentSampleRate;
+	if (pTAS2557->mpFirmware->mnConfigurations)
+		pProfile->mnSamplingRate =
+			pTAS2557->mpFirmware->mpConfigurations[pProfile->mnConfiguration].mnSamplingRate;
+	if (tas2557_get_bit_rate(pTAS2557, &nBitRate) >= 0)
+		pProfile->mnBitRate = nBitRate;
+	else
+		pProfile->mnBitRate = TAS2557_PROFILE_UNCHANGED;
+}
+
+/*
+* reach the whole target state with the fewest loads: a program change
+* takes configuration and calibration along in one power cycle, a
+* configuration change takes the calibration along; the bit rate goes
+* last so a program reset can't undo it. Program and configuration go
+* through the load request slot like the other producers, so the caller
+* must hold codec_lock and file_lock
+*/
+int tas2557_set_profile(struct tas2557_priv *pTAS2557, struct TProfile *pProfile)
+{
+	struct TConfiguration *pConfiguration;
+	unsigned int nProgram, nCurrentConfig;
+	int nConfig, nCalibration;
+	unsigned int nOldCalibration = pTAS2557->mnCurrentCalibration;
+	unsigned char nBitRate = 0;
+	bool bCalibration = false;
+	int nResult = 0;
+
+	if ((!pTAS2557->mpFirmware->mpPrograms)
+		|| (!pTAS2557->mpFirmware->mpConfigurations)) {
+		dev_err(pTAS2557->dev, "Firmware not loaded\n");
+		nResult = -EINVAL;
 		goto end;
 	}
 
-	if (pTAS2557->mnPGID == TAS2557_PG_VERSION_2P1)
-		nReg = TAS2557_PG2P1_CALI_R0_REG;
-	else
-		nReg = TAS2557_PG1P0_CALI_R0_REG;
+	nProgram = pTAS2557->mnCurrentProgram;
+	if (pProfile->mnProgram != TAS2557_PROFILE_UNCHANGED)
+		nProgram = pProfile->mnProgram;
+	if (nProgram >= pTAS2557->mpFirmware->mnPrograms) {
+		dev_err(pTAS2557->dev, "%s, program %d doesn't exist\n", __func__, nProgram);
+		nResult = -EINVAL;
+		goto end;
+	}
 
-	nBlockType = TAS2557_BLOCK_CFG_COEFF_DEV_A;
+	nCurrentConfig = tas2557_target_configuration(pTAS2557);
+	if (pProfile->mnConfiguration != TAS2557_PROFILE_UNCHANGED) {
+		nConfig = pProfile->mnConfiguration;
+		if ((nConfig < 0) || (nConfig >= pTAS2557->mpFirmware->mnConfigurations)) {
+			dev_err(pTAS2557->dev, "%s, configuration %d doesn't exist\n", __func__, nConfig);
+			nResult = -EINVAL;
+			goto end;
+		}
+		pConfiguration = &(pTAS2557->mpFirmware->mpConfigurations[nConfig]);
+		if ((pConfiguration->mnProgram != nProgram)
+			|| ((pProfile->mnSamplingRate != TAS2557_PROFILE_UNCHANGED)
+				&& (pConfiguration->mnSamplingRate != pProfile->mnSamplingRate))) {
+			dev_err(pTAS2557->dev, "%s, configuration %d doesn't match program %d, rate %d\n",
+				__func__, nConfig, nProgram, pProfile->mnSamplingRate);
+			nResult = -EINVAL;
+			goto end;
+		}
+	} else if (pProfile->mnSamplingRate != TAS2557_PROFILE_UNCHANGED) {
+		nConfig = tas2557_find_configuration(pTAS2557, nProgram, pProfile->mnSamplingRate);
+		if (nConfig < 0) {
+			dev_err(pTAS2557->dev, "%s, program %d has no configuration for rate %d\n",
+				__func__, nProgram, pProfile->mnSamplingRate);
+			nResult = -EINVAL;
+			goto end;
+		}
+	} else if (nProgram != pTAS2557->mnCurrentProgram) {
+		/* tas2557_set_program() keeps the current rate */
+		nConfig = -1;
+	} else
+		nConfig = nCurrentConfig;
 
-	pCalibration = &(pTAS2557->mpCalFirmware->mpCalibrations[pTAS2557->mnCurrentCalibration]);
-	pData = &(pCalibration->mData);
+	if (pProfile->mnBitRate != TAS2557_PROFILE_UNCHANGED) {
+		if ((pProfile->mnBitRate != 16) && (pProfile->mnBitRate != 20)
+			&& (pProfile->mnBitRate != 24) && (pProfile->mnBitRate != 32)) {
+			dev_err(pTAS2557->dev, "%s, invalid bit rate %d\n", __func__, pProfile->mnBitRate);
+			nResult = -EINVAL;
+			goto end;
+		}
+	}
 
-	bFound = tas2557_get_coefficient_in_data(pTAS2557, pData, nBlockType, nReg, &nCali_Re);
+	if (pProfile->mnCalibration != TAS2557_PROFILE_UNCHANGED) {
+		nCalibration = pProfile->mnCalibration;
+		if (nCalibration == 0x00FF) {
+			nResult = tas2557_load_calibration(pTAS2557, pTAS2557->mpCalName);
+			if (nResult < 0) {
+				dev_info(pTAS2557->dev, "load new calibration file %s fail %d\n",
+					pTAS2557->mpCalName, nResult);
+				goto end;
+			}
+			nCalibration = 0;
+			bCalibration = true;
+		}
+		if ((nCalibration < 0) || (nCalibration >= pTAS2557->mpCalFirmware->mnCalibrations)) {
+			dev_err(pTAS2557->dev, "%s, calibration %d doesn't exist\n", __func__, nCalibration);
+			nResult = -EINVAL;
+			goto end;
+		}
+		if (nCalibration != pTAS2557->mnCurrentCalibration)
+			bCalibration = true;
+		/* loaded along with any configuration below, kept only if that works */
+		pTAS2557->mnCurrentCalibration = nCalibration;
+	}
+
+	dev_dbg(pTAS2557->dev, "%s, program %d config %d calibration %d\n",
+		__func__, nProgram, nConfig, pTAS2557->mnCurrentCalibration);
+	if (nProgram != pTAS2557->mnCurrentProgram) {
+		tas2557_post_load(pTAS2557, nProgram, nConfig);
+		nResult = tas2557_apply_load(pTAS2557);
+	} else if ((nConfig != nCurrentConfig) || pTAS2557->mbResetRequired) {
+		/* after an interrupted load this becomes a program load */
+		tas2557_post_load(pTAS2557, TAS2557_LOAD_UNCHANGED, nConfig);
+		nResult = tas2557_apply_load(pTAS2557);
+	} else if (bCalibration)
+		nResult = tas2557_set_calibration(pTAS2557, pTAS2557->mnCurrentCalibration);
+	if (nResult < 0) {
+		pTAS2557->mnCurrentCalibration = nOldCalibration;
+		goto end;
+	}
+
+	if (pProfile->mnBitRate != TAS2557_PROFILE_UNCHANGED) {
+		nResult = tas2557_get_bit_rate(pTAS2557, &nBitRate);
+		if ((nResult >= 0) && (nBitRate != pProfile->mnBitRate))
+			nResult = tas2557_set_bit_rate(pTAS2557, pProfile->mnBitRate);
+	}
 
 end:
 
-	if (bFound)
-		*prm_r0 = nCali_Re;
+	return nResult;
+}
 
-	return bFound;
+/* 4 byte 0x85 burst: header, book/page/reg/data0, data1..3 */
+#define	TAS2557_CAL_BURST_COMMANDS	3
+
+static void tas2557_calibration_burst(unsigned char *pCommands, int nReg,
+	unsigned char *pWord)
+{
+	pCommands[0] = 0;
+	pCommands[1] = 4;
+	pCommands[2] = 0x85;
+	pCommands[3] = 0;
+	pCommands[4] = TAS2557_BOOK_ID(nReg);
+	pCommands[5] = TAS2557_PAGE_ID(nReg);
+	pCommands[6] = TAS2557_PAGE_REG(nReg);
+	memcpy(&pCommands[7], pWord, 4);
+	pCommands[11] = 0;
 }
 
-int tas2557_parse_dt(struct device *dev, struct tas2557_priv *pTAS2557)
+/*
+* R0 and T read back after a calibration run become the only calibration,
+* it is applied by the next load of a tuning mode configuration
+*/
+static int tas2557_install_calibration(struct tas2557_priv *pTAS2557,
+	struct TCalibrationRun *pRun, int nR0Reg, unsigned char *pR0,
+	int nTReg, unsigned char *pT)
 {
-	struct device_node *np = dev->of_node;
-	int rc = 0, ret = 0;
-	unsigned int value;
+	struct TFirmware *pCalFirmware = pTAS2557->mpCalFirmware;
+	struct TCalibration *pCalibration;
+	struct TBlock *pBlock;
+	unsigned char *pCommands;
 
-	pTAS2557->mnResetGPIO = of_get_named_gpio(np, "ti,cdc-reset-gpio", 0);
-	if (!gpio_is_valid(pTAS2557->mnResetGPIO)) {
-		dev_err(pTAS2557->dev, "Looking up %s property in node %s failed %d\n",
-			"ti,cdc-reset-gpio", np->full_name,
-			pTAS2557->mnResetGPIO);
-		ret = -EINVAL;
-		goto end;
-	} else
-		dev_dbg(pTAS2557->dev, "ti,cdc-reset-gpio=%d\n", pTAS2557->mnResetGPIO);
+	pCalibration = kzalloc(sizeof(struct TCalibration), GFP_KERNEL);
+	pBlock = kzalloc(sizeof(struct TBlock), GFP_KERNEL);
+	pCommands = kzalloc(2 * TAS2557_CAL_BURST_COMMANDS * 4, GFP_KERNEL);
+	if (!pCalibration || !pBlock || !pCommands) {
+		kfree(pCalibration);
+		kfree(pBlock);
+		kfree(pCommands);
+		return -ENOMEM;
+	}
 
-	pTAS2557->mnGpioINT = of_get_named_gpio(np, "ti,irq-gpio", 0);
-	if (!gpio_is_valid(pTAS2557->mnGpioINT))
-		dev_err(pTAS2557->dev, "Looking up %s property in node %s failed %d\n",
-			"ti,irq-gpio", np->full_name,
-			pTAS2557->mnGpioINT);
+	tas2557_calibration_burst(pCommands, nR0Reg, pR0);
+	tas2557_calibration_burst(pCommands + TAS2557_CAL_BURST_COMMANDS * 4, nTReg, pT);
+	pBlock->mnType = TAS2557_BLOCK_CFG_COEFF_DEV_A;
+	pBlock->mnCommands = 2 * TAS2557_CAL_BURST_COMMANDS;
+	pBlock->mpData = pCommands;
+
+	strlcpy(pCalibration->mpName, "factory", sizeof(pCalibration->mpName));
+	pCalibration->mnProgram = pRun->mnProgram;
+	pCalibration->mnConfiguration = pRun->mnConfiguration;
+	strlcpy(pCalibration->mData.mpName, "factory", sizeof(pCalibration->mData.mpName));
+	pCalibration->mData.mnBlocks = 1;
+	pCalibration->mData.mpBlocks = pBlock;
+	fw_index_coefficients(pTAS2557, &(pCalibration->mData));
+
+	tas2557_clear_firmware(pCalFirmware);
+	pCalFirmware->mnCalibrations = 1;
+	pCalFirmware->mpCalibrations = pCalibration;
+	pTAS2557->mnCurrentCalibration = 0;
+	/* the file no longer matches, 0xFF reads it again */
+	tas2557_calibration_free(pTAS2557);
 
+	return 0;
+}
 
-	rc = of_property_read_u32(np, "ti,i2s-bits", &value);
-	if (rc)
-		dev_err(pTAS2557->dev, "Looking up %s property in node %s failed %d\n",
-			"ti,i2s-bits", np->full_name, rc);
-	else
-		pTAS2557->mnI2SBits = value;
+/*
+* factory calibration as one command: play the calibration program and
+* configuration for mnDurationMs without any calibration applied, read
+* R0 and T, install them and return to the previous program and
+* configuration with the new calibration. Called with codec_lock and
+* file_lock held, every path that reprograms the device waits for the
+* whole measurement
+*/
+int tas2557_run_calibration(struct tas2557_priv *pTAS2557, struct TCalibrationRun *pRun)
+{
+	struct TFirmware *pFirmware = pTAS2557->mpFirmware;
+	struct TFirmware sOldCal;
+	unsigned char pR0[4], pT[4];
+	unsigned int nProgram, nConfiguration, nOldCalibration, n;
+	int nR0Reg, nTReg;
+	bool bPowerUp;
+	int nResult = 0, nRestore;
+
+	if (!pFirmware->mnPrograms || !pFirmware->mnConfigurations) {
+		dev_err(pTAS2557->dev, "Firmware not loaded\n");
+		nResult = -EINVAL;
+		goto end;
+	}
 
-	rc = of_property_read_u32(np, "ti,bypass-tmax", &value);
+	if ((pRun->mnProgram < 0) || (pRun->mnProgram >= pFirmware->mnPrograms)
+		|| (pRun->mnConfiguration < 0)
+		|| (pRun->mnConfiguration >= pFirmware->mnConfigurations)
+		|| (pFirmware->mpConfigurations[pRun->mnConfiguration].mnProgram != pRun->mnProgram)
+		|| (pRun->mnDurationMs > TAS2557_CALIBRATION_MAX_MS)) {
+		dev_err(pTAS2557->dev, "%s, invalid run %d/%d %dms\n", __func__,
+			pRun->mnProgram, pRun->mnConfiguration, pRun->mnDurationMs);
+		nResult = -EINVAL;
+		goto end;
+	}
+
+	if (pTAS2557->mnPGID == TAS2557_PG_VERSION_2P1) {
+		nR0Reg = TAS2557_PG2P1_CALI_R0_REG;
+		nTReg = TAS2557_PG2P1_CALI_T_REG;
+	} else {
+		nR0Reg = TAS2557_PG1P0_CALI_R0_REG;
+		nTReg = TAS2557_PG1P0_CALI_T_REG;
+	}
+
+	nProgram = pTAS2557->mnCurrentProgram;
+	nConfiguration = tas2557_target_configuration(pTAS2557);
+	bPowerUp = pTAS2557->mbPowerUp;
+
+	/*
+	* the measurement runs uncalibrated, the old calibration is put
+	* aside rather than freed so that a failed run gives it back
+	*/
+	sOldCal = *(pTAS2557->mpCalFirmware);
+	nOldCalibration = pTAS2557->mnCurrentCalibration;
+	memset(pTAS2557->mpCalFirmware, 0, sizeof(struct TFirmware));
+
+	nResult = tas2557_set_program(pTAS2557, pRun->mnProgram, pRun->mnConfiguration);
+	if (nResult < 0)
+		goto restore;
+
+	if (!pTAS2557->mbPowerUp) {
+		nResult = tas2557_enable(pTAS2557, true);
+		if (nResult < 0)
+			goto restore;
+	}
+
+	msleep(pRun->mnDurationMs);
+
+	/* the DSP has measured into these, the shadow no longer knows them */
+	for (n = 0; n < 4; n++) {
+		tas2557_shadow_forget(pTAS2557, nR0Reg + n);
+		tas2557_shadow_forget(pTAS2557, nTReg + n);
+	}
+
+	nResult = pTAS2557->bulk_read(pTAS2557, nR0Reg, pR0, 4);
+	if (nResult < 0)
+		goto restore;
+	nResult = pTAS2557->bulk_read(pTAS2557, nTReg, pT, 4);
+	if (nResult < 0)
+		goto restore;
+
+	pRun->mnR0 = ((int)pR0[0] << 24) | ((int)pR0[1] << 16) | ((int)pR0[2] << 8) | (int)pR0[3];
+	pRun->mnT = ((int)pT[0] << 24) | ((int)pT[1] << 16) | ((int)pT[2] << 8) | (int)pT[3];
+	dev_info(pTAS2557->dev, "%s, R0 0x%x, T 0x%x\n", __func__, pRun->mnR0, pRun->mnT);
+
+	nResult = tas2557_install_calibration(pTAS2557, pRun, nR0Reg, pR0, nTReg, pT);
+
+restore:
+	if (nResult < 0) {
+		tas2557_clear_firmware(pTAS2557->mpCalFirmware);
+		*(pTAS2557->mpCalFirmware) = sOldCal;
+		pTAS2557->mnCurrentCalibration = nOldCalibration;
+	} else
+		tas2557_clear_firmware(&sOldCal);
+
+	nRestore = tas2557_set_program(pTAS2557, nProgram, nConfiguration);
+	if ((nRestore >= 0) && (pTAS2557->mbPowerUp != bPowerUp))
+		nRestore = tas2557_enable(pTAS2557, bPowerUp);
+	if (nResult >= 0)
+		nResult = nRestore;
+
+end:
+
+	return nResult;
+}
+
+bool tas2557_get_Cali_prm_r0(struct tas2557_priv *pTAS2557, int *prm_r0)
+{
+	struct TCalibration *pCalibration;
+	struct TData *pData;
+	int nReg;
+	int nCali_Re;
+	bool bFound = false;
+	int nBlockType;
+
+	if (!pTAS2557->mpCalFirmware->mnCalibrations) {
+		dev_err(pTAS2557->dev, "%s, no calibration data\n", __func__);
+		goto end;
+	}
+
+	if (pTAS2557->mnPGID == TAS2557_PG_VERSION_2P1)
+		nReg = TAS2557_PG2P1_CALI_R0_REG;
+	else
+		nReg = TAS2557_PG1P0_CALI_R0_REG;
+
+	nBlockType = TAS2557_BLOCK_CFG_COEFF_DEV_A;
+
+	pCalibration = &(pTAS2557->mpCalFirmware->mpCalibrations[pTAS2557->mnCurrentCalibration]);
+	pData = &(pCalibration->mData);
+
+	bFound = tas2557_get_coefficient_in_data(pTAS2557, pData, nBlockType, nReg, &nCali_Re);
+
+end:
+
+	if (bFound)
+		*prm_r0 = nCali_Re;
+
+	return bFound;
+}
+
+/*
+* download engine: sampling rate and power requests from the stream path
+* are run here so that hw_params and mute don't block on PLL/coefficient
+* downloads, only the unmute waits for the engine to go idle
+*/
+static void tas2557_engine_work_routine(struct work_struct *work)
+{
+	struct tas2557_priv *pTAS2557 =
+		container_of(work, struct tas2557_priv, mEngineWork);
+	unsigned int nSamplingRate;
+	bool bPowerPending, bPowerOn;
+
+	if (tas2557_pm_get(pTAS2557) < 0)
+		return;
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	spin_lock(&pTAS2557->mLoadLock);
+	nSamplingRate = pTAS2557->mnEngineRate;
+	bPowerPending = pTAS2557->mbEnginePowerPending;
+	bPowerOn = pTAS2557->mbEnginePowerOn;
+	pTAS2557->mnEngineRate = 0;
+	pTAS2557->mbEnginePowerPending = false;
+	spin_unlock(&pTAS2557->mLoadLock);
+
+	if (nSamplingRate) {
+		dev_dbg(pTAS2557->dev, "%s, rate %d\n", __func__, nSamplingRate);
+		tas2557_set_sampling_rate(pTAS2557, nSamplingRate);
+	}
+
+	if (bPowerPending) {
+		dev_dbg(pTAS2557->dev, "%s, power %d\n", __func__, bPowerOn);
+		tas2557_enable_mute(pTAS2557, bPowerOn, pTAS2557->mbMute);
+	}
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
+
+	tas2557_pm_put(pTAS2557);
+}
+
+/*
+* CFG_POST once per loaded configuration, CFG_POST_POWER after every
+* power up; a run that finds the amplifier powered down does nothing
+*/
+static void tas2557_post_work_routine(struct work_struct *work)
+{
+	struct tas2557_priv *pTAS2557 =
+		container_of(work, struct tas2557_priv, mPostWork);
+	struct TConfiguration *pConfiguration;
+	int nResult = 0;
+
+	if (tas2557_pm_get(pTAS2557) < 0)
+		return;
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	/* still muted, tas2557_set_mute() queues this again on unmute */
+	if (!pTAS2557->mbPowerUp || pTAS2557->mbMuted
+		|| !pTAS2557->mpFirmware->mnConfigurations)
+		goto end;
+
+	pConfiguration = &(pTAS2557->mpFirmware->mpConfigurations[pTAS2557->mnCurrentConfiguration]);
+	if (pTAS2557->mnPostConfiguration != pTAS2557->mnCurrentConfiguration) {
+		dev_dbg(pTAS2557->dev, "%s, config %s post block\n", __func__, pConfiguration->mpName);
+		nResult = tas2557_load_data(pTAS2557, &(pConfiguration->mData), TAS2557_BLOCK_CFG_POST);
+		if (nResult < 0)
+			goto end;
+		pTAS2557->mnPostConfiguration = pTAS2557->mnCurrentConfiguration;
+	}
+
+	if (pTAS2557->mbPostPowerPending) {
+		pTAS2557->mbPostPowerPending = false;
+		dev_dbg(pTAS2557->dev, "%s, config %s post power block\n", __func__, pConfiguration->mpName);
+		nResult = tas2557_load_data(pTAS2557, &(pConfiguration->mData), TAS2557_BLOCK_CFG_POST_POWER);
+	}
+
+end:
+	if (nResult < 0) {
+		if (pTAS2557->mnErrCode & (ERROR_DEVA_I2C_COMM | ERROR_PRAM_CRCCHK | ERROR_YRAM_CRCCHK))
+			failsafe(pTAS2557);
+	}
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
+
+	tas2557_pm_put(pTAS2557);
+}
+
+/*
+* download the configuration selected while powered down, the digital
+* core takes PLL and coefficients with Class-D off; queued ahead of any
+* power up posted later, so the engine powers up with it loaded
+*/
+static void tas2557_preload_work_routine(struct work_struct *work)
+{
+	struct tas2557_priv *pTAS2557 =
+		container_of(work, struct tas2557_priv, mPreloadWork);
+	int nResult = 0;
+
+	if (tas2557_pm_get(pTAS2557) < 0)
+		return;
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	if (pTAS2557->mbPowerUp || !pTAS2557->mbLoadConfigurationPrePowerUp)
+		goto end;
+
+	dev_dbg(pTAS2557->dev, "%s, configuration %d\n", __func__, pTAS2557->mnNewConfiguration);
+	pTAS2557->mbLoadConfigurationPrePowerUp = false;
+	nResult = tas2557_load_coefficient(pTAS2557,
+		pTAS2557->mnCurrentConfiguration, pTAS2557->mnNewConfiguration, false);
+	if (nResult < 0) {
+		if (pTAS2557->mnErrCode & (ERROR_DEVA_I2C_COMM | ERROR_PRAM_CRCCHK | ERROR_YRAM_CRCCHK))
+			failsafe(pTAS2557);
+	}
+
+end:
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
+
+	tas2557_pm_put(pTAS2557);
+}
+
+static void tas2557_preload_queue(struct tas2557_priv *pTAS2557)
+{
+	if (pTAS2557->mpEngineWQ)
+		queue_work(pTAS2557->mpEngineWQ, &pTAS2557->mPreloadWork);
+}
+
+/*
+* count a configuration change, a saturated row is halved so recent
+* habits keep their weight
+*/
+static void tas2557_prefetch_record(struct tas2557_priv *pTAS2557, int nFrom, int nTo)
+{
+	unsigned int nConfigs = pTAS2557->mpFirmware->mnConfigurations;
+	unsigned short *pRow;
+	unsigned int i;
+
+	if ((nFrom < 0) || (nFrom >= nConfigs) || (nFrom == nTo))
+		return;
+
+	if (pTAS2557->mnPrefetchConfigs != nConfigs) {
+		kfree(pTAS2557->mpPrefetchHistory);
+		pTAS2557->mpPrefetchHistory = kcalloc(nConfigs * nConfigs,
+			sizeof(unsigned short), GFP_KERNEL);
+		pTAS2557->mnPrefetchConfigs = pTAS2557->mpPrefetchHistory ? nConfigs : 0;
+		if (!pTAS2557->mpPrefetchHistory)
+			return;
+	}
+
+	pRow = &(pTAS2557->mpPrefetchHistory[nFrom * nConfigs]);
+	if (pRow[nTo] == USHRT_MAX) {
+		for (i = 0; i < nConfigs; i++)
+			pRow[i] >>= 1;
+	}
+	pRow[nTo]++;
+}
+
+/* most frequent successor of the current configuration, -1 if none stands out */
+static int tas2557_prefetch_predict(struct tas2557_priv *pTAS2557)
+{
+	unsigned int nConfigs = pTAS2557->mnPrefetchConfigs;
+	int nCurrent = pTAS2557->mnCurrentConfiguration;
+	unsigned short *pRow;
+	unsigned int nBest = TAS2557_PREFETCH_MIN_COUNT - 1;
+	int nNext = -1;
+	unsigned int i;
+
+	if (!pTAS2557->mpPrefetchHistory || (nCurrent >= nConfigs))
+		goto end;
+
+	pRow = &(pTAS2557->mpPrefetchHistory[nCurrent * nConfigs]);
+	for (i = 0; i < nConfigs; i++) {
+		if (pRow[i] > nBest) {
+			nBest = pRow[i];
+			nNext = i;
+		}
+	}
+
+end:
+
+	return nNext;
+}
+
+/* on a hit the caller only commits the held swap */
+static bool tas2557_prefetch_take(struct tas2557_priv *pTAS2557, int nConfiguration)
+{
+	int nStaged = pTAS2557->mnStagedConfiguration;
+
+	if (nStaged < 0)
+		return false;
+
+	pTAS2557->mnStagedConfiguration = -1;
+	if ((nStaged == nConfiguration) && pTAS2557->mbSwapPending) {
+		pTAS2557->mPrefetchStats.mnHits++;
+		return true;
+	}
+
+	pTAS2557->mPrefetchStats.mnMisses++;
+	pTAS2557->mbSwapPending = false;
+
+	return false;
+}
+
+/* forget the staged configuration, the caller rewrites or resets the banks */
+static void tas2557_prefetch_drop(struct tas2557_priv *pTAS2557)
+{
+	if (pTAS2557->mnStagedConfiguration < 0)
+		return;
+
+	pTAS2557->mnStagedConfiguration = -1;
+	pTAS2557->mbSwapPending = false;
+	pTAS2557->mPrefetchStats.mnMisses++;
+}
+
+/* write the current configuration back over the inactive bank, swap dropped */
+static int tas2557_prefetch_restore(struct tas2557_priv *pTAS2557)
+{
+	struct TConfiguration *pConfiguration =
+		&(pTAS2557->mpFirmware->mpConfigurations[pTAS2557->mnCurrentConfiguration]);
+	int nResult;
+
+	tas2557_swap_begin(pTAS2557);
+	nResult = tas2557_load_data(pTAS2557, &(pConfiguration->mData),
+		TAS2557_BLOCK_CFG_COEFF_DEV_A);
+	tas2557_swap_commit(pTAS2557, false);
+
+	return nResult;
+}
+
+/*
+* before any swap other than the staged one, or a power down that may
+* bring the inactive bank up, take the staged coefficients out again
+*/
+static int tas2557_prefetch_unstage(struct tas2557_priv *pTAS2557)
+{
+	int nResult = 0;
+
+	if (pTAS2557->mnStagedConfiguration < 0)
+		goto end;
+
+	dev_dbg(pTAS2557->dev, "%s, config %d\n", __func__, pTAS2557->mnStagedConfiguration);
+	tas2557_prefetch_drop(pTAS2557);
+	nResult = tas2557_prefetch_restore(pTAS2557);
+
+end:
+
+	return nResult;
+}
+
+/*
+* stage only while the DSP runs, within the current program and PLL,
+* a configuration switch then costs a single swap
+*/
+static int tas2557_prefetch_stage(struct tas2557_priv *pTAS2557)
+{
+	struct TConfiguration *pCurrent, *pNext;
+	int nNext;
+	int nResult = 0;
+
+	nNext = tas2557_prefetch_predict(pTAS2557);
+	if ((nNext < 0) || (nNext == pTAS2557->mnCurrentConfiguration))
+		goto end;
+
+	pCurrent = &(pTAS2557->mpFirmware->mpConfigurations[pTAS2557->mnCurrentConfiguration]);
+	pNext = &(pTAS2557->mpFirmware->mpConfigurations[nNext]);
+	if (!pNext->mbSwapStage || (pNext->mnProgram != pCurrent->mnProgram)
+		|| !tas2557_same_pll(pTAS2557, pCurrent, pNext))
+		goto end;
+
+	dev_dbg(pTAS2557->dev, "%s, stage config %s\n", __func__, pNext->mpName);
+	tas2557_swap_begin(pTAS2557);
+	nResult = tas2557_load_data(pTAS2557, &(pNext->mData), TAS2557_BLOCK_CFG_COEFF_DEV_A);
+	/* end the level but keep the swap pending for the hit */
+	pTAS2557->mnSwapDepth--;
+	if ((nResult < 0) || !pTAS2557->mbSwapPending) {
+		pTAS2557->mbSwapPending = false;
+		if (nResult >= 0)
+			nResult = tas2557_prefetch_restore(pTAS2557);
+		goto end;
+	}
+
+	pTAS2557->mnStagedConfiguration = nNext;
+	pTAS2557->mPrefetchStats.mnStaged++;
+
+end:
+
+	return nResult;
+}
+
+static void tas2557_prefetch_work_routine(struct work_struct *work)
+{
+	struct tas2557_priv *pTAS2557 =
+		container_of(work, struct tas2557_priv, mPrefetchWork);
+	int nResult = 0;
+
+	if (tas2557_pm_get(pTAS2557) < 0)
+		return;
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	if (!pTAS2557->mbPrefetch || (pTAS2557->mnStagedConfiguration >= 0)
+		|| !pTAS2557->mpFirmware->mnConfigurations
+		|| pTAS2557->mbLoadConfigurationPrePowerUp
+		|| pTAS2557->mbResetRequired
+		|| !(pTAS2557->mbPowerUp || pTAS2557->mbStandby))
+		goto end;
+
+	nResult = tas2557_prefetch_stage(pTAS2557);
+	if (nResult < 0) {
+		if (pTAS2557->mnErrCode & (ERROR_DEVA_I2C_COMM | ERROR_PRAM_CRCCHK | ERROR_YRAM_CRCCHK))
+			failsafe(pTAS2557);
+	}
+
+end:
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
+
+	tas2557_pm_put(pTAS2557);
+}
+
+/* called with the locks held, behind any load already posted to the engine */
+static void tas2557_prefetch_queue(struct tas2557_priv *pTAS2557)
+{
+	if (pTAS2557->mbPrefetch && pTAS2557->mpEngineWQ)
+		queue_work(pTAS2557->mpEngineWQ, &pTAS2557->mPrefetchWork);
+}
+
+/* called with the locks held */
+int tas2557_set_prefetch(struct tas2557_priv *pTAS2557, bool bEnable)
+{
+	int nResult = 0;
+
+	pTAS2557->mbPrefetch = bEnable;
+	if (bEnable)
+		tas2557_prefetch_queue(pTAS2557);
+	else
+		nResult = tas2557_prefetch_unstage(pTAS2557);
+
+	return nResult;
+}
+
+void tas2557_prefetch_free(struct tas2557_priv *pTAS2557)
+{
+	pTAS2557->mnStagedConfiguration = -1;
+	kfree(pTAS2557->mpPrefetchHistory);
+	pTAS2557->mpPrefetchHistory = NULL;
+	pTAS2557->mnPrefetchConfigs = 0;
+}
+
+/* called with the locks held, the blocks run once the caller releases them */
+static void tas2557_post_queue(struct tas2557_priv *pTAS2557, bool bPowerUp)
+{
+	if (bPowerUp)
+		pTAS2557->mbPostPowerPending = true;
+	if (pTAS2557->mpEngineWQ)
+		queue_work(pTAS2557->mpEngineWQ, &pTAS2557->mPostWork);
+}
+
+int tas2557_engine_init(struct tas2557_priv *pTAS2557)
+{
+	int nResult = 0;
+
+	INIT_WORK(&pTAS2557->mEngineWork, tas2557_engine_work_routine);
+	INIT_WORK(&pTAS2557->mPostWork, tas2557_post_work_routine);
+	INIT_WORK(&pTAS2557->mPreloadWork, tas2557_preload_work_routine);
+	INIT_WORK(&pTAS2557->mPrefetchWork, tas2557_prefetch_work_routine);
+	pTAS2557->mnPostConfiguration = -1;
+	pTAS2557->mnStagedConfiguration = -1;
+	pTAS2557->mpEngineWQ = create_singlethread_workqueue("tas2557_engine");
+	if (!pTAS2557->mpEngineWQ) {
+		dev_err(pTAS2557->dev, "%s, no workqueue\n", __func__);
+		nResult = -ENOMEM;
+	}
+
+	return nResult;
+}
+
+void tas2557_engine_exit(struct tas2557_priv *pTAS2557)
+{
+	if (pTAS2557->mpEngineWQ) {
+		destroy_workqueue(pTAS2557->mpEngineWQ);
+		pTAS2557->mpEngineWQ = NULL;
+	}
+}
+
+void tas2557_engine_post_rate(struct tas2557_priv *pTAS2557, unsigned int nSamplingRate)
+{
+	spin_lock(&pTAS2557->mLoadLock);
+	pTAS2557->mnEngineRate = nSamplingRate;
+	spin_unlock(&pTAS2557->mLoadLock);
+
+	queue_work(pTAS2557->mpEngineWQ, &pTAS2557->mEngineWork);
+}
+
+/* the last power request wins if the engine hasn't picked up the previous one */
+void tas2557_engine_post_power(struct tas2557_priv *pTAS2557, bool bEnable)
+{
+	spin_lock(&pTAS2557->mLoadLock);
+	pTAS2557->mbEnginePowerPending = true;
+	pTAS2557->mbEnginePowerOn = bEnable;
+	spin_unlock(&pTAS2557->mLoadLock);
+
+	queue_work(pTAS2557->mpEngineWQ, &pTAS2557->mEngineWork);
+}
+
+/* must not be called with codec_lock or file_lock held */
+void tas2557_engine_wait(struct tas2557_priv *pTAS2557)
+{
+	flush_work(&pTAS2557->mPreloadWork);
+	flush_work(&pTAS2557->mEngineWork);
+}
+
+/*
+* registers not replayed from the shadow: book/page select, reset, power,
+* mute and pin enables belong to the power sequences, CRC and flags are
+* status and the coefficient swap is an action
+*/
+static bool tas2557_shadow_volatile(unsigned int nRegister)
+{
+	unsigned char nBook = TAS2557_BOOK_ID(nRegister);
+	unsigned char nPage = TAS2557_PAGE_ID(nRegister);
+	unsigned char nReg = TAS2557_PAGE_REG(nRegister);
+
+	if (nReg == TAS2557_PAGECTL_REG)
+		return true;
+	if ((nPage == TAS2557_BOOKCTL_PAGE) && (nReg == TAS2557_BOOKCTL_REG))
+		return true;
+	if (isSwapReg(nBook, nPage, nReg))
+		return true;
+
+	switch (nRegister) {
+	case TAS2557_SW_RESET_REG:
+	case TAS2557_POWER_CTRL1_REG:
+	case TAS2557_POWER_CTRL2_REG:
+	case TAS2557_MUTE_REG:
+	case TAS2557_SOFT_MUTE_REG:
+	case TAS2557_CRC_CHECKSUM_REG:
+	case TAS2557_CRC_RESET_REG:
+	case TAS2557_CLK_ERR_CTRL:
+	case TAS2557_GPI_PIN_REG:
+	case TAS2557_GPIO1_PIN_REG:
+	case TAS2557_GPIO2_PIN_REG:
+		return true;
+	}
+
+	if ((nRegister >= TAS2557_POWER_UP_FLAG_REG) && (nRegister <= TAS2557_FLAGS_2))
+		return true;
+
+	return false;
+}
+
+static struct TShadowPage *tas2557_shadow_page(struct tas2557_priv *pTAS2557,
+	unsigned char nBook, unsigned char nPage, bool bCreate)
+{
+	struct TShadow *pShadow = &pTAS2557->mShadow;
+	struct TShadowPage *pPages;
+	unsigned int nKey = (nBook << 8) | nPage;
+	unsigned int nLow = 0, nHigh = pShadow->mnPages, nMid, nMidKey;
+
+	/* downloads stay on one page for a while */
+	if (pShadow->mnLast < pShadow->mnPages) {
+		pPages = &pShadow->mpPages[pShadow->mnLast];
+		if ((pPages->mnBook == nBook) && (pPages->mnPage == nPage))
+			return pPages;
+	}
+
+	while (nLow < nHigh) {
+		nMid = (nLow + nHigh) / 2;
+		nMidKey = (pShadow->mpPages[nMid].mnBook << 8) | pShadow->mpPages[nMid].mnPage;
+		if (nMidKey == nKey) {
+			pShadow->mnLast = nMid;
+			return &pShadow->mpPages[nMid];
+		}
+		if (nMidKey < nKey)
+			nLow = nMid + 1;
+		else
+			nHigh = nMid;
+	}
+
+	if (!bCreate)
+		return NULL;
+
+	if (pShadow->mnPages == pShadow->mnCapacity) {
+		pPages = krealloc(pShadow->mpPages,
+			(pShadow->mnCapacity + 16) * sizeof(struct TShadowPage), GFP_KERNEL);
+		if (!pPages) {
+			pShadow->mbLost = true;
+			return NULL;
+		}
+		pShadow->mpPages = pPages;
+		pShadow->mnCapacity += 16;
+	}
+
+	memmove(&pShadow->mpPages[nLow + 1], &pShadow->mpPages[nLow],
+		(pShadow->mnPages - nLow) * sizeof(struct TShadowPage));
+	pShadow->mnPages++;
+	pPages = &pShadow->mpPages[nLow];
+	memset(pPages, 0, sizeof(struct TShadowPage));
+	pPages->mnBook = nBook;
+	pPages->mnPage = nPage;
+	pShadow->mnLast = nLow;
+
+	return pPages;
+}
+
+/* called by the register access layer with dev_lock held */
+void tas2557_shadow_record(struct tas2557_priv *pTAS2557,
+	unsigned int nRegister, const unsigned char *pData, unsigned int nLength)
+{
+	struct TShadowPage *pPage = NULL;
+	unsigned int i, nReg, nBank;
+	unsigned char nMask;
+
+	if (nRegister == TAS2557_SW_RESET_REG) {
+		if (pData[0] & 0x01)
+			tas2557_shadow_reset(pTAS2557);
+		return;
+	}
+
+	if (pTAS2557->mShadow.mbLost)
+		return;
+
+	nBank = pTAS2557->mShadow.mnBank;
+	for (i = 0; i < nLength; i++) {
+		nReg = nRegister + i;
+		/* a burst never crosses into the next page */
+		if (i && !TAS2557_PAGE_REG(nReg))
+			break;
+		/* the last swap byte flips the banks */
+		if (nReg == (TAS2557_SA_COEFF_SWAP_REG + 4))
+			pTAS2557->mShadow.mnBank ^= 1;
+		if (tas2557_shadow_volatile(nReg))
+			continue;
+		if (!pPage) {
+			pPage = tas2557_shadow_page(pTAS2557,
+				TAS2557_BOOK_ID(nReg), TAS2557_PAGE_ID(nReg), true);
+			if (!pPage)
+				return;
+		}
+		nMask = 1 << (TAS2557_PAGE_REG(nReg) & 7);
+		pPage->mpValid[TAS2557_PAGE_REG(nReg) >> 3] |= nMask;
+		pPage->mpValue[TAS2557_PAGE_REG(nReg)] = pData[i];
+		pPage->mpBankValid[nBank][TAS2557_PAGE_REG(nReg) >> 3] |= nMask;
+		pPage->mpBank[nBank][TAS2557_PAGE_REG(nReg)] = pData[i];
+	}
+}
+
+/* an update_bits result isn't known without a read, stop trusting it */
+void tas2557_shadow_forget(struct tas2557_priv *pTAS2557, unsigned int nRegister)
+{
+	struct TShadowPage *pPage;
+	unsigned char nReg = TAS2557_PAGE_REG(nRegister);
+	unsigned char nMask = ~(1 << (nReg & 7));
+
+	if (pTAS2557->mShadow.mbLost)
+		return;
+
+	pPage = tas2557_shadow_page(pTAS2557,
+		TAS2557_BOOK_ID(nRegister), TAS2557_PAGE_ID(nRegister), false);
+	if (!pPage)
+		return;
+
+	pPage->mpValid[nReg >> 3] &= nMask;
+	pPage->mpBankValid[0][nReg >> 3] &= nMask;
+	pPage->mpBankValid[1][nReg >> 3] &= nMask;
+}
+
+/* the device has been reset, nothing written before is retained */
+void tas2557_shadow_reset(struct tas2557_priv *pTAS2557)
+{
+	pTAS2557->mShadow.mnPages = 0;
+	pTAS2557->mShadow.mnLast = 0;
+	pTAS2557->mShadow.mbLost = false;
+	pTAS2557->mShadow.mnBank = 0;
+}
+
+void tas2557_shadow_free(struct tas2557_priv *pTAS2557)
+{
+	kfree(pTAS2557->mShadow.mpPages);
+	pTAS2557->mShadow.mpPages = NULL;
+	pTAS2557->mShadow.mnCapacity = 0;
+	tas2557_shadow_reset(pTAS2557);
+	pTAS2557->mnSentinels = 0;
+}
+
+static bool tas2557_shadow_valid(struct TShadowPage *pPage, unsigned int nReg)
+{
+	return pPage->mpValid[nReg >> 3] & (1 << (nReg & 7));
+}
+
+/*
+* a sentinel must read back what was written for as long as the device
+* keeps power: no YRAM, where a calibration run measures into R0 and
+* T, and no self-clearing, status or book select register
+*/
+static bool tas2557_sentinel_ok(struct tas2557_priv *pTAS2557, struct TShadowPage *pPage,
+	unsigned int nReg)
+{
+	unsigned int nRegister = TAS2557_REG(pPage->mnBook, pPage->mnPage, nReg);
+	struct TYCRC sCRCData;
+
+	if (!tas2557_shadow_valid(pPage, nReg))
+		return false;
+
+	switch (nRegister) {
+	case TAS2557_SW_RESET_REG:
+	case TAS2557_CRC_CHECKSUM_REG:
+	case TAS2557_CRC_RESET_REG:
+	case TAS2557_POWER_UP_FLAG_REG:
+	case TAS2557_FLAGS_1:
+	case TAS2557_FLAGS_2:
+	case TAS2557_SA_COEFF_SWAP_REG:
+		return false;
+	}
+
+	if ((pPage->mnPage == TAS2557_BOOKCTL_PAGE) && (nReg == TAS2557_BOOKCTL_REG))
+		return false;
+
+	return !isYRAM(pTAS2557, &sCRCData, pPage->mnBook, pPage->mnPage, nReg, 1);
+}
+
+/*
+* pick sentinels spread over the written registers for the resume
+* check; called on suspend with the locks held
+*/
+int tas2557_snapshot_save(struct tas2557_priv *pTAS2557)
+{
+	struct TShadow *pShadow = &pTAS2557->mShadow;
+	struct TShadowPage *pPage;
+	struct TSentinel *pSentinel;
+	unsigned int nPage, nReg, nCount = 0, nIndex = 0, nStep;
+
+	pTAS2557->mnSentinels = 0;
+
+	if (pShadow->mbLost || !pShadow->mnPages || pTAS2557->mbResetRequired)
+		goto end;
+
+	for (nPage = 0; nPage < pShadow->mnPages; nPage++)
+		for (nReg = 1; nReg < 128; nReg++)
+			if (tas2557_sentinel_ok(pTAS2557, &pShadow->mpPages[nPage], nReg))
+				nCount++;
+	if (!nCount)
+		goto end;
+
+	nStep = (nCount + TAS2557_SNAPSHOT_SENTINELS - 1) / TAS2557_SNAPSHOT_SENTINELS;
+	for (nPage = 0; nPage < pShadow->mnPages; nPage++) {
+		pPage = &pShadow->mpPages[nPage];
+		for (nReg = 1; nReg < 128; nReg++) {
+			if (!tas2557_sentinel_ok(pTAS2557, pPage, nReg))
+				continue;
+			if (!(nIndex++ % nStep)) {
+				pSentinel = &pTAS2557->mSentinels[pTAS2557->mnSentinels++];
+				pSentinel->mnReg = TAS2557_REG(pPage->mnBook, pPage->mnPage, nReg);
+				pSentinel->mnValue = pPage->mpValue[nReg];
+			}
+		}
+	}
+
+	dev_dbg(pTAS2557->dev, "%s, %d sentinels of %d registers\n",
+		__func__, pTAS2557->mnSentinels, nCount);
+
+end:
+
+	return 0;
+}
+
+/* safe guard plus the sentinels, all must still read back */
+static bool tas2557_snapshot_retained(struct tas2557_priv *pTAS2557)
+{
+	struct TSentinel *pSentinel;
+	unsigned int nValue = 0, n;
+
+	if (pTAS2557->read(pTAS2557, TAS2557_SAFE_GUARD_REG, &nValue) < 0)
+		return false;
+	if ((nValue & 0xff) != TAS2557_SAFE_GUARD_PATTERN)
+		return false;
+
+	for (n = 0; n < pTAS2557->mnSentinels; n++) {
+		pSentinel = &pTAS2557->mSentinels[n];
+		if (pTAS2557->read(pTAS2557, pSentinel->mnReg, &nValue) < 0)
+			return false;
+		if ((nValue & 0xff) != pSentinel->mnValue)
+			return false;
+	}
+
+	return true;
+}
+
+/*
+* on resume: nothing to do if the device kept its state, otherwise a
+* full reload, which replays the program, configuration and calibration
+* blocks in firmware order with their delays and swaps; without
+* sentinels the state can't be told apart from a lost one
+*/
+int tas2557_snapshot_restore(struct tas2557_priv *pTAS2557)
+{
+	bool bPowerUp = pTAS2557->mbPowerUp;
+	int nResult = 0;
+
+	if (pTAS2557->mnSentinels && tas2557_snapshot_retained(pTAS2557)) {
+		dev_dbg(pTAS2557->dev, "%s, state retained\n", __func__);
+		goto end;
+	}
+
+	dev_info(pTAS2557->dev, "%s, state lost, reload program %d\n",
+		__func__, pTAS2557->mnCurrentProgram);
+	pTAS2557->mbResetRequired = true;
+	pTAS2557->mbPowerUp = false;
+	pTAS2557->mbStandby = false;
+	nResult = tas2557_set_program(pTAS2557, pTAS2557->mnCurrentProgram,
+		pTAS2557->mnCurrentConfiguration);
+
+	if (bPowerUp) {
+		tas2557_power_ref(pTAS2557, false);
+		if (nResult >= 0)
+			nResult = tas2557_enable_mute(pTAS2557, true, pTAS2557->mbMuted);
+	}
+
+end:
+
+	return nResult;
+}
+
+int tas2557_parse_dt(struct device *dev, struct tas2557_priv *pTAS2557)
+{
+	struct device_node *np = dev->of_node;
+	int rc = 0, ret = 0;
+	unsigned int value;
+	const char *pCalName;
+
+	pTAS2557->mnResetGPIO = of_get_named_gpio(np, "ti,cdc-reset-gpio", 0);
+	if (!gpio_is_valid(pTAS2557->mnResetGPIO)) {
+		dev_err(pTAS2557->dev, "Looking up %s property in node %s failed %d\n",
+			"ti,cdc-reset-gpio", np->full_name,
+			pTAS2557->mnResetGPIO);
+		ret = -EINVAL;
+		goto end;
+	} else
+		dev_dbg(pTAS2557->dev, "ti,cdc-reset-gpio=%d\n", pTAS2557->mnResetGPIO);
+
+	pTAS2557->mnGpioINT = of_get_named_gpio(np, "ti,irq-gpio", 0);
+	if (!gpio_is_valid(pTAS2557->mnGpioINT))
+		dev_err(pTAS2557->dev, "Looking up %s property in node %s failed %d\n",
+			"ti,irq-gpio", np->full_name,
+			pTAS2557->mnGpioINT);
+
+
+	rc = of_property_read_u32(np, "ti,i2s-bits", &value);
+	if (rc)
+		dev_err(pTAS2557->dev, "Looking up %s property in node %s failed %d\n",
+			"ti,i2s-bits", np->full_name, rc);
+	else
+		pTAS2557->mnI2SBits = value;
+
+	rc = of_property_read_u32(np, "ti,bypass-tmax", &value);
 	if (rc)
 		dev_err(pTAS2557->dev, "Looking up %s property in node %s failed %d\n",
 			"ti,bypass-tmax", np->full_name, rc);
 	else
 		pTAS2557->mbBypassTMax = (value > 0);
 
+	rc = of_property_read_u32(np, "ti,verify-policy", &value);
+	if (!rc)
+		pTAS2557->mnVerifyPolicy = value;
+
+	rc = of_property_read_u32(np, "ti,verify-sample-pct", &value);
+	if (!rc)
+		pTAS2557->mnVerifySamplePct = value;
+
+	rc = of_property_read_u32(np, "ti,standby-timeout-ms", &value);
+	if (!rc)
+		pTAS2557->mnStandbyTimeoutMs = value;
+
+	rc = of_property_read_u32(np, "ti,delay-hoist", &value);
+	if (!rc)
+		pTAS2557->mbDelayHoist = (value > 0);
+
+	rc = of_property_read_string(np, "ti,cal-name", &pCalName);
+	if (!rc)
+		strlcpy(pTAS2557->mpCalName, pCalName, sizeof(pTAS2557->mpCalName));
+
+	rc = of_property_read_u32(np, "ti,delta-write", &value);
+	if (!rc)
+		pTAS2557->mbDeltaWrite = (value > 0);
+
+	rc = of_property_read_u32(np, "ti,prefetch", &value);
+	if (!rc)
+		pTAS2557->mbPrefetch = (value > 0);
+
+	if ((pTAS2557->mnVerifyPolicy >= TAS2557_VERIFY_MODES)
+		|| (pTAS2557->mnVerifySamplePct > 100)) {
+		dev_err(pTAS2557->dev, "invalid %s %d, %s %d\n",
+			"ti,verify-policy", pTAS2557->mnVerifyPolicy,
+			"ti,verify-sample-pct", pTAS2557->mnVerifySamplePct);
+		pTAS2557->mnVerifyPolicy = TAS2557_VERIFY_FULL;
+		pTAS2557->mnVerifySamplePct = TAS2557_VERIFY_SAMPLE_PCT;
+	}
+
 end:
 
 	return ret;
@@ -59,14 +59,31 @@ struct TYCRC {
 	unsigned char mnLen;
 };
 
+/* YRAM bytes of one page written by a block, waiting for read back */
+struct TYRAMPage {
+	unsigned char mnBook;
+	unsigned char mnPage;
+	unsigned char mnStart;
+	unsigned char mnEnd;
+	bool mbDirty;
+	unsigned int mnBytesRead;
+	unsigned char mpWritten[128];
+	unsigned char mpData[128];
+};
+
 int tas2557_enable(struct tas2557_priv *pTAS2557, bool bEnable);
+int tas2557_set_mute(struct tas2557_priv *pTAS2557, bool bMute);
 int tas2557_SA_DevChnSetup(struct tas2557_priv *pTAS2557, unsigned int mode);
 int tas2557_get_die_temperature(struct tas2557_priv *pTAS2557, int *pTemperature);
 int tas2557_set_sampling_rate(struct tas2557_priv *pTAS2557, unsigned int nSamplingRate);
+int tas2557_plan_sampling_rate(struct tas2557_priv *pTAS2557,
+	unsigned int nSamplingRate, struct TRatePlan *pPlan);
 int tas2557_set_bit_rate(struct tas2557_priv *pTAS2557, unsigned int nBitRate);
 int tas2557_get_bit_rate(struct tas2557_priv *pTAS2557, unsigned char *pBitRate);
 int tas2557_set_config(struct tas2557_priv *pTAS2557, int config);
 void tas2557_fw_ready(const struct firmware *pFW, void *pContext);
+bool tas2557_get_fw_coefficient(struct tas2557_priv *pTAS2557,
+	unsigned int nDataType, unsigned int nIndex, int nReg, int *pnValue);
 bool tas2557_get_Cali_prm_r0(struct tas2557_priv *pTAS2557, int *prm_r0);
 int tas2557_set_program(struct tas2557_priv *pTAS2557, unsigned int nProgram, int nConfig);
 int tas2557_set_calibration(struct tas2557_priv *pTAS2557, int nCalibration);
@@ -75,4 +92,33 @@ int tas2557_parse_dt(struct device *dev, struct tas2557_priv *pTAS2557);
 int tas2557_get_DAC_gain(struct tas2557_priv *pTAS2557, unsigned char *pnGain);
 int tas2557_set_DAC_gain(struct tas2557_priv *pTAS2557, unsigned int nGain);
 int tas2557_configIRQ(struct tas2557_priv *pTAS2557);
+void tas2557_post_load(struct tas2557_priv *pTAS2557, int nProgram, int nConfig);
+int tas2557_apply_load(struct tas2557_priv *pTAS2557);
+int tas2557_standby_off(struct tas2557_priv *pTAS2557);
+int tas2557_pm_get(struct tas2557_priv *pTAS2557);
+void tas2557_pm_put(struct tas2557_priv *pTAS2557);
+int tas2557_set_standby_timeout(struct tas2557_priv *pTAS2557, unsigned int nTimeoutMs);
+int tas2557_engine_init(struct tas2557_priv *pTAS2557);
+void tas2557_engine_exit(struct tas2557_priv *pTAS2557);
+void tas2557_engine_post_rate(struct tas2557_priv *pTAS2557, unsigned int nSamplingRate);
+void tas2557_engine_post_power(struct tas2557_priv *pTAS2557, bool bEnable);
+void tas2557_engine_wait(struct tas2557_priv *pTAS2557);
+int tas2557_set_verify_policy(struct tas2557_priv *pTAS2557,
+	unsigned int nPolicy, unsigned int nSamplePct);
+void tas2557_shadow_record(struct tas2557_priv *pTAS2557,
+	unsigned int nRegister, const unsigned char *pData, unsigned int nLength);
+void tas2557_shadow_forget(struct tas2557_priv *pTAS2557, unsigned int nRegister);
+void tas2557_shadow_reset(struct tas2557_priv *pTAS2557);
+void tas2557_shadow_free(struct tas2557_priv *pTAS2557);
+int tas2557_snapshot_save(struct tas2557_priv *pTAS2557);
+int tas2557_snapshot_restore(struct tas2557_priv *pTAS2557);
+int tas2557_fault_shutdown(struct tas2557_priv *pTAS2557);
+void tas2557_update_error(struct tas2557_priv *pTAS2557,
+	unsigned int nMask, unsigned int nValue);
+void tas2557_calibration_free(struct tas2557_priv *pTAS2557);
+int tas2557_set_prefetch(struct tas2557_priv *pTAS2557, bool bEnable);
+void tas2557_prefetch_free(struct tas2557_priv *pTAS2557);
+void tas2557_get_profile(struct tas2557_priv *pTAS2557, struct TProfile *pProfile);
+int tas2557_set_profile(struct tas2557_priv *pTAS2557, struct TProfile *pProfile);
+int tas2557_run_calibration(struct tas2557_priv *pTAS2557, struct TCalibrationRun *pRun);
 #endif /* _TAS2557_CORE_H */
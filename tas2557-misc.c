@@ -44,6 +44,7 @@
 #include "tas2557-core.h"
 #include "tas2557-misc.h"
 #include <linux/dma-mapping.h>
+#include <linux/pm_runtime.h>
 
 static int g_logEnable = 1;
 static struct tas2557_priv *g_tas2557;
@@ -55,6 +56,12 @@ static int tas2557_file_open(struct inode *inode, struct file *file)
 	if (!try_module_get(THIS_MODULE))
 		return -ENODEV;
 
+	/* tuning sessions keep the device resumed until release */
+	if (tas2557_pm_get(pTAS2557) < 0) {
+		module_put(THIS_MODULE);
+		return -EIO;
+	}
+
 	file->private_data = (void *)pTAS2557;
 	if (g_logEnable)
 		dev_info(pTAS2557->dev,	"%s\n", __func__);
@@ -68,6 +75,7 @@ static int tas2557_file_release(struct inode *inode, struct file *file)
 	if (g_logEnable)
 		dev_info(pTAS2557->dev,	"%s\n", __func__);
 	file->private_data = (void *)NULL;
+	tas2557_pm_put(pTAS2557);
 	module_put(THIS_MODULE);
 
 	return 0;
@@ -253,6 +261,48 @@ static ssize_t tas2557_file_read(struct file *file, char *buf, size_t count, lof
 	}
 	break;
 
+	case TIAUDIO_CMD_RATE_COST: {
+		if (g_logEnable)
+			dev_info(pTAS2557->dev, "TIAUDIO_CMD_RATE_COST: count = %d\n", (int)count);
+		/* planned by the write, which holds codec_lock for the shadow walk */
+		if (count == 8) {
+			if (pTAS2557->mnRatePlanResult < 0) {
+				dev_err(pTAS2557->dev, "no rate plan, %d\n", pTAS2557->mnRatePlanResult);
+				break;
+			}
+			ret = copy_to_user(buf, pTAS2557->mpRatePlan, count);
+			if (ret != 0) {
+				/* Failed to copy all the data, exit */
+				dev_err(pTAS2557->dev, "copy to user fail %d\n", ret);
+			}
+		}
+	}
+	break;
+
+	case TIAUDIO_CMD_FW_COEFF: {
+		if (g_logEnable)
+			dev_info(pTAS2557->dev, "TIAUDIO_CMD_FW_COEFF: count = %d\n", (int)count);
+		/* found, then the coefficient, big endian */
+		if (count == 5) {
+			unsigned char pCoeff[5];
+			int nCoefficient = 0;
+
+			pCoeff[0] = tas2557_get_fw_coefficient(pTAS2557,
+				pTAS2557->mnCoeffQueryData, pTAS2557->mnCoeffQueryIndex,
+				pTAS2557->mnCoeffQueryReg, &nCoefficient);
+			pCoeff[1] = ((nCoefficient&0xff000000)>>24);
+			pCoeff[2] = ((nCoefficient&0x00ff0000)>>16);
+			pCoeff[3] = ((nCoefficient&0x0000ff00)>>8);
+			pCoeff[4] = (nCoefficient&0x000000ff);
+			ret = copy_to_user(buf, pCoeff, count);
+			if (ret != 0) {
+				/* Failed to copy all the data, exit */
+				dev_err(pTAS2557->dev, "copy to user fail %d\n", ret);
+			}
+		}
+	}
+	break;
+
 	case TIAUDIO_CMD_BITRATE: {
 		if (g_logEnable)
 			dev_info(pTAS2557->dev,
@@ -305,6 +355,10 @@ static ssize_t tas2557_file_write(struct file *file, const char *buf, size_t cou
 	unsigned int reg = 0;
 	unsigned int len = 0;
 
+	/* loads and power changes serialize with the codec paths as the workers do */
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
 	mutex_lock(&pTAS2557->file_lock);
 
 	p_kBuf = kzalloc(count, GFP_KERNEL);
@@ -363,13 +417,10 @@ static ssize_t tas2557_file_write(struct file *file, const char *buf, size_t cou
 		if (count == 2) {
 			if ((pTAS2557->mpFirmware->mnConfigurations > 0)
 				&& (pTAS2557->mpFirmware->mnPrograms > 0)) {
-				int config = -1;
-
-				if (p_kBuf[1] == pTAS2557->mnCurrentProgram)
-					config = pTAS2557->mnCurrentConfiguration;
 				if (g_logEnable)
-					dev_info(pTAS2557->dev, "TIAUDIO_CMD_PROGRAM, set to %d, cfg=%d\n", p_kBuf[1], config);
-				tas2557_set_program(pTAS2557, p_kBuf[1], config);
+					dev_info(pTAS2557->dev, "TIAUDIO_CMD_PROGRAM, set to %d\n", p_kBuf[1]);
+				tas2557_post_load(pTAS2557, p_kBuf[1], TAS2557_LOAD_KEEP_CONFIG);
+				tas2557_apply_load(pTAS2557);
 				pTAS2557->mnDBGCmd = 0;
 			} else
 				dev_err(pTAS2557->dev, "%s, firmware not loaded\n", __func__);
@@ -384,7 +435,8 @@ static ssize_t tas2557_file_write(struct file *file, const char *buf, size_t cou
 			&& (pTAS2557->mpFirmware->mnPrograms > 0)) {
 				if (g_logEnable)
 					dev_info(pTAS2557->dev, "TIAUDIO_CMD_CONFIGURATION, set to %d\n", p_kBuf[1]);
-				tas2557_set_config(pTAS2557, p_kBuf[1]);
+				tas2557_post_load(pTAS2557, TAS2557_LOAD_UNCHANGED, p_kBuf[1]);
+				tas2557_apply_load(pTAS2557);
 				pTAS2557->mnDBGCmd = 0;
 			} else
 				dev_err(pTAS2557->dev, "%s, firmware not loaded\n", __func__);
@@ -423,6 +475,56 @@ static ssize_t tas2557_file_write(struct file *file, const char *buf, size_t cou
 		}
 	break;
 
+	case TIAUDIO_CMD_RATE_COST:
+		/*
+		* the plan is returned by the next read: kind, program,
+		* configuration, 0, then cost in us, little endian
+		*/
+		if (count == 5) {
+			struct TRatePlan sPlan;
+			unsigned char *pPlan = pTAS2557->mpRatePlan;
+			unsigned int nRate = ((unsigned int)p_kBuf[1] << 24) +
+				((unsigned int)p_kBuf[2] << 16) +
+				((unsigned int)p_kBuf[3] << 8) +
+				(unsigned int)p_kBuf[4];
+
+			if (g_logEnable)
+				dev_info(pTAS2557->dev, "TIAUDIO_CMD_RATE_COST, rate %d\n", nRate);
+			pTAS2557->mnRatePlanResult = tas2557_plan_sampling_rate(pTAS2557, nRate, &sPlan);
+			if (pTAS2557->mnRatePlanResult < 0)
+				break;
+			/* one byte each, 0xff is left for "none" */
+			if ((sPlan.mnKind != TAS2557_RATE_NONE)
+				&& ((sPlan.mnProgram >= 0xff) || (sPlan.mnConfiguration >= 0xff))) {
+				dev_err(pTAS2557->dev, "rate plan %d/%d doesn't fit the reply\n",
+					sPlan.mnProgram, sPlan.mnConfiguration);
+				pTAS2557->mnRatePlanResult = -EINVAL;
+				break;
+			}
+
+			pPlan[0] = sPlan.mnKind;
+			pPlan[1] = sPlan.mnProgram;
+			pPlan[2] = sPlan.mnConfiguration;
+			pPlan[3] = 0;
+			pPlan[4] = (sPlan.mnCostUs&0x000000ff);
+			pPlan[5] = ((sPlan.mnCostUs&0x0000ff00)>>8);
+			pPlan[6] = ((sPlan.mnCostUs&0x00ff0000)>>16);
+			pPlan[7] = ((sPlan.mnCostUs&0xff000000)>>24);
+		}
+	break;
+
+	case TIAUDIO_CMD_FW_COEFF:
+		/* data type, index, book, page, register; read back by the next read */
+		if (count == 6) {
+			pTAS2557->mnCoeffQueryData = p_kBuf[1];
+			pTAS2557->mnCoeffQueryIndex = p_kBuf[2];
+			pTAS2557->mnCoeffQueryReg = TAS2557_REG(p_kBuf[3], p_kBuf[4], p_kBuf[5]);
+			if (g_logEnable)
+				dev_info(pTAS2557->dev, "TIAUDIO_CMD_FW_COEFF, %d[%d] B[0x%x]P[0x%x]R[0x%x]\n",
+					p_kBuf[1], p_kBuf[2], p_kBuf[3], p_kBuf[4], p_kBuf[5]);
+		}
+	break;
+
 	case TIAUDIO_CMD_BITRATE:
 		if (count == 2) {
 			if (g_logEnable)
@@ -462,8 +564,12 @@ static ssize_t tas2557_file_write(struct file *file, const char *buf, size_t cou
 			else
 				break;
 
+			/* dropped by tas2557_fw_ready */
+			pm_runtime_get_noresume(pTAS2557->dev);
 			ret = request_firmware_nowait(THIS_MODULE, 1, pFWName,
 				pTAS2557->dev, GFP_KERNEL, pTAS2557, tas2557_fw_ready);
+			if (ret < 0)
+				tas2557_pm_put(pTAS2557);
 
 			if (g_logEnable)
 				dev_info(pTAS2557->dev, "TIAUDIO_CMD_FW_RELOAD: ret = %d\n", ret);
@@ -480,6 +586,9 @@ err:
 		kfree(p_kBuf);
 
 	mutex_unlock(&pTAS2557->file_lock);
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
 
 	return count;
 }
@@ -489,6 +598,18 @@ static long tas2557_file_unlocked_ioctl(struct file *file, unsigned int cmd, uns
 	struct tas2557_priv *pTAS2557 = file->private_data;
 	int ret = 0;
 
+	/* post before waiting for the locks, so a load in flight is superseded */
+	if ((pTAS2557->mpFirmware->mnConfigurations > 0)
+		&& (pTAS2557->mpFirmware->mnPrograms > 0)) {
+		if (cmd == SMARTPA_SPK_SWITCH_PROGRAM)
+			tas2557_post_load(pTAS2557, arg, -1);
+		else if (cmd == SMARTPA_SPK_SWITCH_CONFIGURATION)
+			tas2557_post_load(pTAS2557, TAS2557_LOAD_UNCHANGED, arg);
+	}
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
 	mutex_lock(&pTAS2557->file_lock);
 
 	switch (cmd) {
@@ -510,18 +631,13 @@ static long tas2557_file_unlocked_ioctl(struct file *file, unsigned int cmd, uns
 	break;
 
 	case SMARTPA_SPK_SWITCH_PROGRAM:
-	{
-		if ((pTAS2557->mpFirmware->mnConfigurations > 0)
-			&& (pTAS2557->mpFirmware->mnPrograms > 0))
-			tas2557_set_program(pTAS2557, arg, -1);
-	}
-	break;
-
 	case SMARTPA_SPK_SWITCH_CONFIGURATION:
 	{
 		if ((pTAS2557->mpFirmware->mnConfigurations > 0)
 			&& (pTAS2557->mpFirmware->mnPrograms > 0))
-			tas2557_set_config(pTAS2557, arg);
+			ret = tas2557_apply_load(pTAS2557);
+		else
+			dev_err(pTAS2557->dev, "%s, firmware not loaded\n", __func__);
 	}
 	break;
 
@@ -544,9 +660,43 @@ static long tas2557_file_unlocked_ioctl(struct file *file, unsigned int cmd, uns
 		tas2557_set_bit_rate(pTAS2557, arg);
 	}
 	break;
+
+	case SMARTPA_SPK_SET_PROFILE:
+	{
+		struct TProfile sProfile;
+
+		if (copy_from_user(&sProfile, (void __user *)arg, sizeof(sProfile))) {
+			ret = -EFAULT;
+			break;
+		}
+		ret = tas2557_set_profile(pTAS2557, &sProfile);
+		tas2557_get_profile(pTAS2557, &sProfile);
+		if (copy_to_user((void __user *)arg, &sProfile, sizeof(sProfile)))
+			ret = -EFAULT;
+	}
+	break;
+
+	case SMARTPA_SPK_CALIBRATE:
+	{
+		struct TCalibrationRun sRun;
+
+		if (copy_from_user(&sRun, (void __user *)arg, sizeof(sRun))) {
+			ret = -EFAULT;
+			break;
+		}
+		ret = tas2557_run_calibration(pTAS2557, &sRun);
+		if (ret < 0)
+			break;
+		if (copy_to_user((void __user *)arg, &sRun, sizeof(sRun)))
+			ret = -EFAULT;
+	}
+	break;
 	}
 
 	mutex_unlock(&pTAS2557->file_lock);
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
 	return ret;
 }
 
@@ -39,6 +39,8 @@
 #define	TIAUDIO_CMD_DACVOLUME			10
 #define	TIAUDIO_CMD_SPEAKER				11
 #define	TIAUDIO_CMD_FW_RELOAD			12
+#define	TIAUDIO_CMD_RATE_COST			13
+#define	TIAUDIO_CMD_FW_COEFF			14
 
 #define	TAS2557_MAGIC_NUMBER	0x32353537	/* '2557' */
 
@@ -50,6 +52,9 @@
 #define	SMARTPA_SPK_SWITCH_CALIBRATION		_IOWR(TAS2557_MAGIC_NUMBER, 6, unsigned long)
 #define	SMARTPA_SPK_SET_SAMPLERATE			_IOWR(TAS2557_MAGIC_NUMBER, 7, unsigned long)
 #define	SMARTPA_SPK_SET_BITRATE				_IOWR(TAS2557_MAGIC_NUMBER, 8, unsigned long)
+/* struct TProfile in, the resulting state out */
+#define	SMARTPA_SPK_SET_PROFILE				_IOWR(TAS2557_MAGIC_NUMBER, 9, struct TProfile)
+#define	SMARTPA_SPK_CALIBRATE				_IOWR(TAS2557_MAGIC_NUMBER, 10, struct TCalibrationRun)
 
 int tas2557_register_misc(struct tas2557_priv *pTAS2557);
 int tas2557_deregister_misc(struct tas2557_priv *pTAS2557);
@@ -27,6 +27,7 @@
 #include <linux/init.h>
 #include <linux/delay.h>
 #include <linux/pm.h>
+#include <linux/pm_runtime.h>
 #include <linux/i2c.h>
 #include <linux/gpio.h>
 #include <linux/regulator/consumer.h>
@@ -58,6 +59,71 @@
 #define LOW_TEMPERATURE_GAIN 6
 #define LOW_TEMPERATURE_COUNTER 12
 
+#define TAS2557_BATCH_RETRY_MAX	3
+
+/*
+* send the queued bursts as one transfer, dev_lock held; a failure is
+* kept for the next batch_flush, the queued bytes may be partly written
+*/
+static int tas2557_batch_send(struct tas2557_priv *pTAS2557)
+{
+	struct TWriteBatch *pBatch = &pTAS2557->mBatch;
+	struct i2c_client *pClient = to_i2c_client(pTAS2557->dev);
+	int nResult = 0;
+	int nRetry = TAS2557_BATCH_RETRY_MAX;
+
+	if (!pBatch->mnMsgs)
+		goto end;
+
+	do {
+		nResult = i2c_transfer(pClient->adapter, pBatch->mpMsgs, pBatch->mnMsgs);
+		if (nResult == pBatch->mnMsgs)
+			break;
+		if (nResult >= 0)
+			nResult = -EIO;
+		dev_err(pTAS2557->dev, "%s, %d, I2C error %d\n",
+			__func__, __LINE__, nResult);
+		nRetry--;
+	} while (nRetry > 0);
+
+	if (nResult < 0) {
+		pTAS2557->mbPageLost = true;
+		pTAS2557->mShadow.mbLost = true;
+		pTAS2557->mnErrCode |= ERROR_DEVA_I2C_COMM;
+		if (!pBatch->mnError)
+			pBatch->mnError = nResult;
+	} else {
+		pTAS2557->mnCurrentBook = pBatch->mnBook;
+		pTAS2557->mnCurrentPage = pBatch->mnPage;
+		pTAS2557->mbPageLost = false;
+		pTAS2557->mnErrCode &= ~ERROR_DEVA_I2C_COMM;
+		nResult = 0;
+	}
+
+	pBatch->mnMsgs = 0;
+	pBatch->mnBytes = 0;
+
+end:
+
+	return nResult;
+}
+
+static void tas2557_batch_msg(struct tas2557_priv *pTAS2557,
+	unsigned char nReg, const unsigned char *pData, unsigned int nLength)
+{
+	struct TWriteBatch *pBatch = &pTAS2557->mBatch;
+	struct i2c_msg *pMsg = &pBatch->mpMsgs[pBatch->mnMsgs++];
+	unsigned char *pBuf = &pBatch->mpBuf[pBatch->mnBytes];
+
+	pBuf[0] = nReg;
+	memcpy(pBuf + 1, pData, nLength);
+	pMsg->addr = to_i2c_client(pTAS2557->dev)->addr;
+	pMsg->flags = 0;
+	pMsg->len = nLength + 1;
+	pMsg->buf = pBuf;
+	pBatch->mnBytes += nLength + 1;
+}
+
 static int tas2557_change_book_page(
 	struct tas2557_priv *pTAS2557,
 	unsigned char nBook,
@@ -65,11 +131,15 @@ static int tas2557_change_book_page(
 {
 	int nResult = 0;
 
-	if ((pTAS2557->mnCurrentBook == nBook) 
+	/* queued bursts go out before any other access */
+	tas2557_batch_send(pTAS2557);
+
+	if (!pTAS2557->mbPageLost
+		&& (pTAS2557->mnCurrentBook == nBook) 
 		&& pTAS2557->mnCurrentPage == nPage)
 		goto end;
 
-	if (pTAS2557->mnCurrentBook != nBook) {
+	if (pTAS2557->mbPageLost || (pTAS2557->mnCurrentBook != nBook)) {
 		nResult = regmap_write(pTAS2557->mpRegmap, TAS2557_BOOKCTL_PAGE, 0);
 		if (nResult < 0) {
 			dev_err(pTAS2557->dev, "%s, %d, I2C error %d\n",
@@ -84,6 +154,7 @@ static int tas2557_change_book_page(
 			goto end;
 		}
 		pTAS2557->mnCurrentBook = nBook;
+		pTAS2557->mbPageLost = false;
 		if (nPage != 0) {
 			nResult = regmap_write(pTAS2557->mpRegmap, TAS2557_BOOKCTL_PAGE, nPage);
 			if (nResult < 0) {
@@ -193,8 +264,12 @@ static int tas2557_dev_write(
 			dev_err(pTAS2557->dev, "%s, %d, I2C error %d\n",
 				__func__, __LINE__, nResult);
 			pTAS2557->mnErrCode |= ERROR_DEVA_I2C_COMM;
-		} else
+		} else {
+			unsigned char nData = nValue;
+
 			pTAS2557->mnErrCode &= ~ERROR_DEVA_I2C_COMM;
+			tas2557_shadow_record(pTAS2557, nRegister, &nData, 1);
+		}
 	}
 
 end:
@@ -275,8 +350,10 @@ static int tas2557_dev_bulk_write(
 			dev_err(pTAS2557->dev, "%s, %d, I2C error %d\n",
 				__func__, __LINE__, nResult);
 			pTAS2557->mnErrCode |= ERROR_DEVA_I2C_COMM;
-		} else
+		} else {
 			pTAS2557->mnErrCode &= ~ERROR_DEVA_I2C_COMM;
+			tas2557_shadow_record(pTAS2557, nRegister, pData, nLength);
+		}
 	}
 
 end:
@@ -285,6 +362,69 @@ end:
 	return nResult;
 }
 
+/*
+* queue a burst behind the ones already waiting; the batch selects book
+* and page itself and the shadow records the bytes in queue order
+*/
+static int tas2557_dev_batch_write(
+	struct tas2557_priv *pTAS2557,
+	unsigned int nRegister,
+	u8 *pData,
+	unsigned int nLength)
+{
+	struct TWriteBatch *pBatch = &pTAS2557->mBatch;
+	unsigned char nBook = TAS2557_BOOK_ID(nRegister);
+	unsigned char nPage = TAS2557_PAGE_ID(nRegister);
+	unsigned char nZero = 0;
+	int nResult = 0;
+
+	mutex_lock(&pTAS2557->dev_lock);
+	if (pTAS2557->mbTILoadActive)
+		goto end; /* let only writes from TILoad pass. */
+
+	if ((nLength + 7) > TAS2557_BATCH_BYTES) {
+		dev_err(pTAS2557->dev, "%s, burst of %d too long\n",
+			__func__, nLength);
+		nResult = -EINVAL;
+		goto end;
+	}
+
+	/* room for a full book/page select and the burst */
+	if (((pBatch->mnMsgs + 4) > TAS2557_BATCH_MSGS)
+		|| ((pBatch->mnBytes + nLength + 7) > TAS2557_BATCH_BYTES))
+		tas2557_batch_send(pTAS2557);
+
+	if (!pBatch->mnMsgs || (pBatch->mnBook != nBook)) {
+		tas2557_batch_msg(pTAS2557, TAS2557_BOOKCTL_PAGE, &nZero, 1);
+		tas2557_batch_msg(pTAS2557, TAS2557_BOOKCTL_REG, &nBook, 1);
+		tas2557_batch_msg(pTAS2557, TAS2557_BOOKCTL_PAGE, &nPage, 1);
+	} else if (pBatch->mnPage != nPage)
+		tas2557_batch_msg(pTAS2557, TAS2557_BOOKCTL_PAGE, &nPage, 1);
+	pBatch->mnBook = nBook;
+	pBatch->mnPage = nPage;
+
+	tas2557_batch_msg(pTAS2557, TAS2557_PAGE_REG(nRegister), pData, nLength);
+	tas2557_shadow_record(pTAS2557, nRegister, pData, nLength);
+
+end:
+
+	mutex_unlock(&pTAS2557->dev_lock);
+	return nResult;
+}
+
+static int tas2557_dev_batch_flush(struct tas2557_priv *pTAS2557)
+{
+	int nResult = 0;
+
+	mutex_lock(&pTAS2557->dev_lock);
+	tas2557_batch_send(pTAS2557);
+	nResult = pTAS2557->mBatch.mnError;
+	pTAS2557->mBatch.mnError = 0;
+	mutex_unlock(&pTAS2557->dev_lock);
+
+	return nResult;
+}
+
 static int tas2557_dev_update_bits(
 	struct tas2557_priv *pTAS2557,
 	unsigned int nRegister,
@@ -316,8 +456,10 @@ static int tas2557_dev_update_bits(
 			dev_err(pTAS2557->dev, "%s, %d, I2C error %d\n",
 				__func__, __LINE__, nResult);
 			pTAS2557->mnErrCode |= ERROR_DEVA_I2C_COMM;
-		} else
+		} else {
 			pTAS2557->mnErrCode &= ~ERROR_DEVA_I2C_COMM;
+			tas2557_shadow_forget(pTAS2557, nRegister);
+		}
 	}
 
 end:
@@ -361,16 +503,75 @@ static void tas2557_hw_reset(struct tas2557_priv *pTAS2557)
 {
 	if (gpio_is_valid(pTAS2557->mnResetGPIO)) {
 		gpio_direction_output(pTAS2557->mnResetGPIO, 0);
-		msleep(5);
+		usleep_range(TAS2557_RESET_PULSE_US, TAS2557_RESET_PULSE_US + 500);
 		gpio_direction_output(pTAS2557->mnResetGPIO, 1);
-		msleep(2);
+		usleep_range(TAS2557_RESET_SETTLE_US, TAS2557_RESET_SETTLE_US + 200);
 	}
 
 	pTAS2557->mnCurrentBook = -1;
 	pTAS2557->mnCurrentPage = -1;
+	tas2557_shadow_reset(pTAS2557);
 	if (pTAS2557->mnErrCode)
 		dev_info(pTAS2557->dev, "before reset, ErrCode=0x%x\n", pTAS2557->mnErrCode);
-	pTAS2557->mnErrCode = 0;
+	tas2557_update_error(pTAS2557, ~0U, 0);
+}
+
+/*
+* FLAGS_1/FLAGS_2 into mnErrCode, true on a critical fault:
+* INT_OC, INT_UV, INT_OT, INT_BO, INT_CL, INT_CLK1, INT_CLK2
+*/
+static bool tas2557_decode_flags(struct tas2557_priv *pTAS2557,
+	unsigned int nDevInt1Status, unsigned int nDevInt2Status)
+{
+	unsigned int nErrCode = 0;
+
+	if (((nDevInt1Status & 0xfc) == 0) && ((nDevInt2Status & 0x0c) == 0))
+		return false;
+
+	dev_err(pTAS2557->dev, "critical error: 0x%x, 0x%x\n", nDevInt1Status, nDevInt2Status);
+	if (nDevInt1Status & 0x80) {
+		nErrCode |= ERROR_OVER_CURRENT;
+		dev_err(pTAS2557->dev, "DEVA SPK over current!\n");
+	}
+
+	if (nDevInt1Status & 0x40) {
+		nErrCode |= ERROR_UNDER_VOLTAGE;
+		dev_err(pTAS2557->dev, "DEVA SPK under voltage!\n");
+	}
+
+	if (nDevInt1Status & 0x20) {
+		nErrCode |= ERROR_CLK_HALT;
+		dev_err(pTAS2557->dev, "DEVA clk halted!\n");
+	}
+
+	if (nDevInt1Status & 0x10) {
+		nErrCode |= ERROR_DIE_OVERTEMP;
+		dev_err(pTAS2557->dev, "DEVA die over temperature!\n");
+	}
+
+	if (nDevInt1Status & 0x08) {
+		nErrCode |= ERROR_BROWNOUT;
+		dev_err(pTAS2557->dev, "DEVA brownout!\n");
+	}
+
+	if (nDevInt1Status & 0x04) {
+		nErrCode |= ERROR_CLK_LOST;
+		dev_err(pTAS2557->dev, "DEVA clock lost!\n");
+	}
+
+	if (nDevInt2Status & 0x08) {
+		nErrCode |= ERROR_CLK_DET1;
+		dev_err(pTAS2557->dev, "DEVA clk detection 1!\n");
+	}
+
+	if (nDevInt2Status & 0x04) {
+		nErrCode |= ERROR_CLK_DET2;
+		dev_err(pTAS2557->dev, "DEVA clk detection 2!\n");
+	}
+
+	tas2557_update_error(pTAS2557, TAS2557_ERROR_FLAGS, nErrCode);
+
+	return true;
 }
 
 static void irq_work_routine(struct work_struct *work)
@@ -379,6 +580,7 @@ static void irq_work_routine(struct work_struct *work)
 	unsigned int nDevInt1Status = 0, nDevInt2Status = 0;
 	unsigned int nDevPowerUpFlag = 0;
 	int nCounter = 2;
+	bool bFault;
 	struct tas2557_priv *pTAS2557 =
 		container_of(work, struct tas2557_priv, irq_work.work);
 
@@ -390,6 +592,11 @@ static void irq_work_routine(struct work_struct *work)
 	mutex_lock(&pTAS2557->file_lock);
 #endif
 
+	mutex_lock(&pTAS2557->fault_lock);
+	bFault = pTAS2557->mbIRQFault;
+	pTAS2557->mbIRQFault = false;
+	mutex_unlock(&pTAS2557->fault_lock);
+
 	if(pTAS2557->mnErrCode & ERROR_FAILSAFE)
 		goto program;
 
@@ -408,6 +615,11 @@ static void irq_work_routine(struct work_struct *work)
 		dev_info(pTAS2557->dev, "%s, firmware not loaded\n", __func__);
 		goto end;
 	}
+
+	/* already decoded by the IRQ thread, the flags read back clear */
+	if (bFault)
+		goto program;
+
 	nResult = tas2557_dev_write(pTAS2557, TAS2557_GPIO4_PIN_REG, 0x00);
 	if (nResult < 0)
 		goto program;
@@ -417,66 +629,16 @@ static void irq_work_routine(struct work_struct *work)
 	if (nResult < 0)
 		goto program;
 
-	if (((nDevInt1Status & 0xfc) != 0) || ((nDevInt2Status & 0x0c) != 0)) {
-		/* in case of INT_OC, INT_UV, INT_OT, INT_BO, INT_CL, INT_CLK1, INT_CLK2 */
-		dev_err(pTAS2557->dev, "critical error: 0x%x, 0x%x\n", nDevInt1Status, nDevInt2Status);
-		if (nDevInt1Status & 0x80) {
-			pTAS2557->mnErrCode |= ERROR_OVER_CURRENT;
-			dev_err(pTAS2557->dev, "DEVA SPK over current!\n");
-		} else
-			pTAS2557->mnErrCode &= ~ERROR_OVER_CURRENT;
-
-		if (nDevInt1Status & 0x40) {
-			pTAS2557->mnErrCode |= ERROR_UNDER_VOLTAGE;
-			dev_err(pTAS2557->dev, "DEVA SPK under voltage!\n");
-		} else
-			pTAS2557->mnErrCode &= ~ERROR_UNDER_VOLTAGE;
-
-		if (nDevInt1Status & 0x20) {
-			pTAS2557->mnErrCode |= ERROR_CLK_HALT;
-			dev_err(pTAS2557->dev, "DEVA clk halted!\n");
-		} else
-			pTAS2557->mnErrCode &= ~ERROR_CLK_HALT;
-
-		if (nDevInt1Status & 0x10) {
-			pTAS2557->mnErrCode |= ERROR_DIE_OVERTEMP;
-			dev_err(pTAS2557->dev, "DEVA die over temperature!\n");
-		} else
-			pTAS2557->mnErrCode &= ~ERROR_DIE_OVERTEMP;
-
-		if (nDevInt1Status & 0x08) {
-			pTAS2557->mnErrCode |= ERROR_BROWNOUT;
-			dev_err(pTAS2557->dev, "DEVA brownout!\n");
-		} else
-			pTAS2557->mnErrCode &= ~ERROR_BROWNOUT;
-
-		if (nDevInt1Status & 0x04) {
-			pTAS2557->mnErrCode |= ERROR_CLK_LOST;
-			dev_err(pTAS2557->dev, "DEVA clock lost!\n");
-		} else
-			pTAS2557->mnErrCode &= ~ERROR_CLK_LOST;
-
-		if (nDevInt2Status & 0x08) {
-			pTAS2557->mnErrCode |= ERROR_CLK_DET1;
-			dev_err(pTAS2557->dev, "DEVA clk detection 1!\n");
-		} else
-			pTAS2557->mnErrCode &= ~ERROR_CLK_DET1;
-
-		if (nDevInt2Status & 0x04) {
-			pTAS2557->mnErrCode |= ERROR_CLK_DET2;
-			dev_err(pTAS2557->dev, "DEVA clk detection 2!\n");
-		} else
-			pTAS2557->mnErrCode &= ~ERROR_CLK_DET2;
-
+	if (tas2557_decode_flags(pTAS2557, nDevInt1Status, nDevInt2Status))
 		goto program;
-	} else {
+	else {
 		dev_dbg(pTAS2557->dev, "IRQ Status: 0x%x, 0x%x\n", nDevInt1Status, nDevInt2Status);
 		nCounter = 2;
 		while (nCounter > 0) {
 			nResult = tas2557_dev_read(pTAS2557, TAS2557_POWER_UP_FLAG_REG, &nDevPowerUpFlag);
 			if (nResult < 0)
 				goto program;
-			if ((nDevPowerUpFlag & 0xc0) == 0xc0)
+			if ((nDevPowerUpFlag & TAS2557_POWER_UP_FLAG_MASK) == TAS2557_POWER_UP_FLAG_MASK)
 				break;
 			nCounter--;
 			if (nCounter > 0) {
@@ -486,17 +648,17 @@ static void irq_work_routine(struct work_struct *work)
 				msleep(10);
 			}
 		}
-		if ((nDevPowerUpFlag & 0xc0) != 0xc0) {
+		if ((nDevPowerUpFlag & TAS2557_POWER_UP_FLAG_MASK) != TAS2557_POWER_UP_FLAG_MASK) {
 			dev_err(pTAS2557->dev, "%s, Critical ERROR B[%d]_P[%d]_R[%d]= 0x%x\n",
 				__func__,
 				TAS2557_BOOK_ID(TAS2557_POWER_UP_FLAG_REG),
 				TAS2557_PAGE_ID(TAS2557_POWER_UP_FLAG_REG),
 				TAS2557_PAGE_REG(TAS2557_POWER_UP_FLAG_REG),
 				nDevPowerUpFlag);
-			pTAS2557->mnErrCode |= ERROR_CLASSD_PWR;
+			tas2557_update_error(pTAS2557, ERROR_CLASSD_PWR, ERROR_CLASSD_PWR);
 			goto program;
 		}
-		pTAS2557->mnErrCode &= ~ERROR_CLASSD_PWR;
+		tas2557_update_error(pTAS2557, ERROR_CLASSD_PWR, 0);
 
 		dev_dbg(pTAS2557->dev, "%s: INT1=0x%x, INT2=0x%x; PowerUpFlag=0x%x\n",
 			__func__, nDevInt1Status, nDevInt2Status, nDevPowerUpFlag);
@@ -506,6 +668,7 @@ static void irq_work_routine(struct work_struct *work)
 program:
 	/* hardware reset and reload */
 	nResult = -1;
+	pTAS2557->mbResetRequired = true;
 	tas2557_set_program(pTAS2557, pTAS2557->mnCurrentProgram, pTAS2557->mnCurrentConfiguration);
 
 end:
@@ -522,13 +685,53 @@ end:
 #endif
 }
 
-static irqreturn_t tas2557_irq_handler(int irq, void *dev_id)
+/*
+* the flags are read as soon as the line is raised, a critical fault
+* shuts the output down here and the reload runs from irq_work at once.
+* Only codec_lock and file_lock are left out, a reload can hold them for
+* long: the flag reads go through dev_lock like any register access, the
+* power state check, the IRQ enable, the shutdown and mbIRQFault take
+* fault_lock, so the shutdown sequence never lands inside a firmware
+* block or register sequence, nor between a power down sequence and
+* its mbPowerUp/mbStandby update
+*/
+static irqreturn_t tas2557_irq_thread(int irq, void *dev_id)
 {
 	struct tas2557_priv *pTAS2557 = (struct tas2557_priv *)dev_id;
+	unsigned int nDevInt1Status = 0, nDevInt2Status = 0;
+	int nResult;
+
+	mutex_lock(&pTAS2557->fault_lock);
+	if (pTAS2557->mbRuntimeSuspend || !pTAS2557->mbPowerUp) {
+		/* enabled again by the next power up */
+		tas2557_enableIRQ(pTAS2557, false, false);
+		mutex_unlock(&pTAS2557->fault_lock);
+		return IRQ_HANDLED;
+	}
+	mutex_unlock(&pTAS2557->fault_lock);
+
+	nResult = tas2557_dev_write(pTAS2557, TAS2557_GPIO4_PIN_REG, 0x00);
+	if (nResult >= 0)
+		nResult = tas2557_dev_read(pTAS2557, TAS2557_FLAGS_1, &nDevInt1Status);
+	if (nResult >= 0)
+		nResult = tas2557_dev_read(pTAS2557, TAS2557_FLAGS_2, &nDevInt2Status);
 
+	if ((nResult >= 0)
+		&& !tas2557_decode_flags(pTAS2557, nDevInt1Status, nDevInt2Status)) {
+		dev_dbg(pTAS2557->dev, "IRQ Status: 0x%x, 0x%x\n", nDevInt1Status, nDevInt2Status);
+		tas2557_dev_write(pTAS2557, TAS2557_GPIO4_PIN_REG, 0x07);
+		return IRQ_HANDLED;
+	}
+
+	mutex_lock(&pTAS2557->fault_lock);
 	tas2557_enableIRQ(pTAS2557, false, false);
-	/* get IRQ status after 100 ms */
-	schedule_delayed_work(&pTAS2557->irq_work, msecs_to_jiffies(100));
+	/* a power down or suspend may have finished while the flags were read */
+	if ((nResult >= 0) && pTAS2557->mbPowerUp && !pTAS2557->mbRuntimeSuspend)
+		tas2557_fault_shutdown(pTAS2557);
+	pTAS2557->mbIRQFault = true;
+	mutex_unlock(&pTAS2557->fault_lock);
+	schedule_delayed_work(&pTAS2557->irq_work, 0);
+
 	return IRQ_HANDLED;
 }
 
@@ -536,13 +739,9 @@ static enum hrtimer_restart temperature_timer_func(struct hrtimer *timer)
 {
 	struct tas2557_priv *pTAS2557 = container_of(timer, struct tas2557_priv, mtimer);
 
-	if (pTAS2557->mbPowerUp) {
+	/* faults are reported by the IRQ thread */
+	if (pTAS2557->mbPowerUp)
 		schedule_work(&pTAS2557->mtimerwork);
-		if (gpio_is_valid(pTAS2557->mnGpioINT)) {
-			tas2557_enableIRQ(pTAS2557, false, false);
-			schedule_delayed_work(&pTAS2557->irq_work, msecs_to_jiffies(1));
-		}
-	}
 	return HRTIMER_NORESTART;
 }
 
@@ -633,19 +832,22 @@ static int tas2557_runtime_suspend(struct tas2557_priv *pTAS2557)
 	dev_dbg(pTAS2557->dev, "%s\n", __func__);
 
 	pTAS2557->mbRuntimeSuspend = true;
+	tas2557_standby_off(pTAS2557);
+	tas2557_snapshot_save(pTAS2557);
 
 	if (hrtimer_active(&pTAS2557->mtimer)) {
 		dev_dbg(pTAS2557->dev, "cancel die temp timer\n");
 		hrtimer_cancel(&pTAS2557->mtimer);
 	}
-	if (work_pending(&pTAS2557->mtimerwork)) {
-		dev_dbg(pTAS2557->dev, "cancel timer work\n");
-		cancel_work_sync(&pTAS2557->mtimerwork);
-	}
+	/*
+	* called with the locks the works take, so nothing is waited for
+	* here; a work already running finds mbRuntimeSuspend once it gets
+	* the locks and leaves the device alone
+	*/
 	if (gpio_is_valid(pTAS2557->mnGpioINT)) {
 		if (delayed_work_pending(&pTAS2557->irq_work)) {
 			dev_dbg(pTAS2557->dev, "cancel IRQ work\n");
-			cancel_delayed_work_sync(&pTAS2557->irq_work);
+			cancel_delayed_work(&pTAS2557->irq_work);
 		}
 	}
 
@@ -657,6 +859,12 @@ static int tas2557_runtime_resume(struct tas2557_priv *pTAS2557)
 	struct TProgram *pProgram;
 
 	dev_dbg(pTAS2557->dev, "%s\n", __func__);
+	/*
+	* cleared before any early exit, a firmware loaded later must not
+	* find the IRQ thread and the works still ignoring the device
+	*/
+	pTAS2557->mbRuntimeSuspend = false;
+
 	if (!pTAS2557->mpFirmware->mpPrograms) {
 		dev_dbg(pTAS2557->dev, "%s, firmware not loaded\n", __func__);
 		goto end;
@@ -667,6 +875,8 @@ static int tas2557_runtime_resume(struct tas2557_priv *pTAS2557)
 		goto end;
 	}
 
+	tas2557_snapshot_restore(pTAS2557);
+
 	pProgram = &(pTAS2557->mpFirmware->mpPrograms[pTAS2557->mnCurrentProgram]);
 	if (pTAS2557->mbPowerUp && (pProgram->mnAppMode == TAS2557_APP_TUNINGMODE)) {
 		if (!hrtimer_active(&pTAS2557->mtimer)) {
@@ -677,7 +887,6 @@ static int tas2557_runtime_resume(struct tas2557_priv *pTAS2557)
 		}
 	}
 
-	pTAS2557->mbRuntimeSuspend = false;
 end:
 
 	return 0;
@@ -702,6 +911,303 @@ static const struct regmap_config tas2557_i2c_regmap = {
 	.max_register = 128,
 };
 
+static const char * const tas2557_verify_policy_text[TAS2557_VERIFY_MODES] = {
+	"full", "sampled", "crc", "off"
+};
+
+static ssize_t verify_policy_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%s %d%s\n",
+		tas2557_verify_policy_text[pTAS2557->mnVerifyPolicy],
+		pTAS2557->mnVerifySamplePct,
+		pTAS2557->mbVerifyEscalated ? " escalated" : "");
+}
+
+/* "<full|sampled|crc|off> [sample percent]" */
+static ssize_t verify_policy_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+	char pName[16];
+	unsigned int nPolicy, nSamplePct;
+	int nResult, n;
+
+	n = sscanf(buf, "%15s %u", pName, &nSamplePct);
+	if (n < 1)
+		return -EINVAL;
+
+	for (nPolicy = 0; nPolicy < TAS2557_VERIFY_MODES; nPolicy++)
+		if (!strcmp(pName, tas2557_verify_policy_text[nPolicy]))
+			break;
+	if (n < 2)
+		nSamplePct = pTAS2557->mnVerifySamplePct;
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	nResult = tas2557_set_verify_policy(pTAS2557, nPolicy, nSamplePct);
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
+
+	return (nResult < 0) ? nResult : count;
+}
+
+static ssize_t verify_stats_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+	struct TVerifyStats *pStats;
+	ssize_t n = 0;
+	int i;
+
+	n += scnprintf(buf + n, PAGE_SIZE - n,
+		"mode blocks bursts bytes_read yram_err pram_err escalations\n");
+	for (i = 0; i < TAS2557_VERIFY_MODES; i++) {
+		pStats = &pTAS2557->mVerifyStats[i];
+		n += scnprintf(buf + n, PAGE_SIZE - n, "%s %u %u %u %u %u %u\n",
+			tas2557_verify_policy_text[i], pStats->mnBlocks,
+			pStats->mnBursts, pStats->mnBytesRead, pStats->mnYRAMErrors,
+			pStats->mnPRAMErrors, pStats->mnEscalations);
+	}
+
+	return n;
+}
+
+static ssize_t standby_timeout_ms_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%u\n", pTAS2557->mnStandbyTimeoutMs);
+}
+
+static ssize_t standby_timeout_ms_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+	unsigned int nTimeoutMs;
+	int nResult;
+
+	nResult = kstrtouint(buf, 0, &nTimeoutMs);
+	if (nResult < 0)
+		return nResult;
+
+	/* may suspend right away, the suspend callback takes the locks */
+	pm_runtime_set_autosuspend_delay(pTAS2557->dev, nTimeoutMs);
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	nResult = tas2557_set_standby_timeout(pTAS2557, nTimeoutMs);
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
+
+	return (nResult < 0) ? nResult : count;
+}
+
+static ssize_t prefetch_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%d\n", pTAS2557->mbPrefetch);
+}
+
+static ssize_t prefetch_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+	bool bEnable;
+	int nResult;
+
+	nResult = kstrtobool(buf, &bEnable);
+	if (nResult < 0)
+		return nResult;
+
+	nResult = tas2557_pm_get(pTAS2557);
+	if (nResult < 0)
+		return nResult;
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	nResult = tas2557_set_prefetch(pTAS2557, bEnable);
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
+
+	tas2557_pm_put(pTAS2557);
+
+	return (nResult < 0) ? nResult : count;
+}
+
+static ssize_t prefetch_stats_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+	struct TPrefetchStats *pStats = &pTAS2557->mPrefetchStats;
+
+	return scnprintf(buf, PAGE_SIZE, "staged %u hits %u misses %u current %d\n",
+		pStats->mnStaged, pStats->mnHits, pStats->mnMisses,
+		pTAS2557->mnStagedConfiguration);
+}
+
+static ssize_t delta_stats_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%s written %u skipped %u\n",
+		pTAS2557->mbDeltaWrite ? "on" : "off",
+		pTAS2557->mnDeltaWritten, pTAS2557->mnDeltaSkipped);
+}
+
+static ssize_t cal_name_show(struct device *dev,
+	struct device_attribute *attr, char *buf)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+
+	return scnprintf(buf, PAGE_SIZE, "%s\n", pTAS2557->mpCalName);
+}
+
+static ssize_t cal_name_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+	char pName[sizeof(pTAS2557->mpCalName)];
+	char *pTrim;
+
+	if (strscpy(pName, buf, sizeof(pName)) < 0)
+		return -EINVAL;
+	pTrim = strim(pName);
+	if (!pTrim[0])
+		return -EINVAL;
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	/* the next Calibration 0xFF reads the new file */
+	strlcpy(pTAS2557->mpCalName, pTrim, sizeof(pTAS2557->mpCalName));
+	tas2557_calibration_free(pTAS2557);
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
+
+	return count;
+}
+
+static DEVICE_ATTR_RW(verify_policy);
+static DEVICE_ATTR_RO(verify_stats);
+static DEVICE_ATTR_RW(standby_timeout_ms);
+static DEVICE_ATTR_RW(prefetch);
+static DEVICE_ATTR_RO(prefetch_stats);
+static DEVICE_ATTR_RO(delta_stats);
+static DEVICE_ATTR_RW(cal_name);
+
+static struct attribute *tas2557_attributes[] = {
+	&dev_attr_verify_policy.attr,
+	&dev_attr_verify_stats.attr,
+	&dev_attr_standby_timeout_ms.attr,
+	&dev_attr_prefetch.attr,
+	&dev_attr_prefetch_stats.attr,
+	&dev_attr_delta_stats.attr,
+	&dev_attr_cal_name.attr,
+	NULL
+};
+
+static const struct attribute_group tas2557_attribute_group = {
+	.attrs = tas2557_attributes,
+};
+
+#ifdef CONFIG_PM
+static int tas2557_pm_runtime_suspend(struct device *dev)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	pTAS2557->runtime_suspend(pTAS2557);
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
+
+	return 0;
+}
+
+static int tas2557_pm_runtime_resume(struct device *dev)
+{
+	struct tas2557_priv *pTAS2557 = dev_get_drvdata(dev);
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_lock(&pTAS2557->codec_lock);
+#endif
+#ifdef CONFIG_TAS2557_MISC
+	mutex_lock(&pTAS2557->file_lock);
+#endif
+
+	pTAS2557->runtime_resume(pTAS2557);
+
+#ifdef CONFIG_TAS2557_MISC
+	mutex_unlock(&pTAS2557->file_lock);
+#endif
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_unlock(&pTAS2557->codec_lock);
+#endif
+
+	return 0;
+}
+#endif
+
+static const struct dev_pm_ops tas2557_pm_ops = {
+	SET_RUNTIME_PM_OPS(tas2557_pm_runtime_suspend, tas2557_pm_runtime_resume, NULL)
+};
+
 /* tas2557_i2c_probe :
 * platform dependent
 * should implement hardware reset functionality
@@ -734,6 +1240,12 @@ static int tas2557_i2c_probe(struct i2c_client *pClient,
 		goto err;
 	}
 
+	pTAS2557->mnVerifyPolicy = TAS2557_VERIFY_FULL;
+	pTAS2557->mnVerifySamplePct = TAS2557_VERIFY_SAMPLE_PCT;
+	pTAS2557->mbDelayHoist = false;
+	pTAS2557->mbDeltaWrite = true;
+	strlcpy(pTAS2557->mpCalName, TAS2557_CAL_NAME, sizeof(pTAS2557->mpCalName));
+
 	if (pClient->dev.of_node)
 		tas2557_parse_dt(&pClient->dev, pTAS2557);
 
@@ -752,6 +1264,10 @@ static int tas2557_i2c_probe(struct i2c_client *pClient,
 	pTAS2557->bulk_read = tas2557_dev_bulk_read;
 	pTAS2557->bulk_write = tas2557_dev_bulk_write;
 	pTAS2557->update_bits = tas2557_dev_update_bits;
+	pTAS2557->batch_write = tas2557_dev_batch_write;
+	pTAS2557->batch_flush = tas2557_dev_batch_flush;
+	/* SMBus-only adapters can't carry several messages in one transfer */
+	pTAS2557->mbBatchCapable = i2c_check_functionality(pClient->adapter, I2C_FUNC_I2C);
 	pTAS2557->enableIRQ = tas2557_enableIRQ;
 	pTAS2557->clearIRQ = tas2557_clearIRQ;
 	pTAS2557->set_config = tas2557_set_config;
@@ -762,6 +1278,8 @@ static int tas2557_i2c_probe(struct i2c_client *pClient,
 	pTAS2557->mnRestart = 0;
 
 	mutex_init(&pTAS2557->dev_lock);
+	mutex_init(&pTAS2557->fault_lock);
+	spin_lock_init(&pTAS2557->mLoadLock);
 
 	/* Reset the chip */
 	nResult = tas2557_dev_write(pTAS2557, TAS2557_SW_RESET_REG, 0x01);
@@ -770,7 +1288,7 @@ static int tas2557_i2c_probe(struct i2c_client *pClient,
 		goto err;
 	}
 
-	msleep(1);
+	usleep_range(TAS2557_SW_RESET_US, TAS2557_SW_RESET_US + 100);
 	tas2557_dev_read(pTAS2557, TAS2557_REV_PGID_REG, &nValue);
 	pTAS2557->mnPGID = nValue;
 	if (pTAS2557->mnPGID == TAS2557_PG_VERSION_2P1) {
@@ -798,8 +1316,8 @@ static int tas2557_i2c_probe(struct i2c_client *pClient,
 		pTAS2557->mnIRQ = gpio_to_irq(pTAS2557->mnGpioINT);
 		dev_dbg(pTAS2557->dev, "irq = %d\n", pTAS2557->mnIRQ);
 		INIT_DELAYED_WORK(&pTAS2557->irq_work, irq_work_routine);
-		nResult = request_threaded_irq(pTAS2557->mnIRQ, tas2557_irq_handler,
-					NULL, IRQF_TRIGGER_HIGH | IRQF_ONESHOT,
+		nResult = request_threaded_irq(pTAS2557->mnIRQ, NULL,
+					tas2557_irq_thread, IRQF_TRIGGER_HIGH | IRQF_ONESHOT,
 				pClient->name, pTAS2557);
 		if (nResult < 0) {
 			dev_err(pTAS2557->dev,
@@ -821,6 +1339,18 @@ static int tas2557_i2c_probe(struct i2c_client *pClient,
 		goto err;
 	}
 
+	nResult = tas2557_engine_init(pTAS2557);
+	if (nResult < 0)
+		goto err;
+
+	/* the idle device autosuspends, ending warm standby */
+	pm_runtime_set_autosuspend_delay(pTAS2557->dev, pTAS2557->mnStandbyTimeoutMs);
+	pm_runtime_use_autosuspend(pTAS2557->dev);
+	pm_runtime_set_active(pTAS2557->dev);
+	/* held until tas2557_fw_ready */
+	pm_runtime_get_noresume(pTAS2557->dev);
+	pm_runtime_enable(pTAS2557->dev);
+
 #ifdef CONFIG_TAS2557_CODEC
 	mutex_init(&pTAS2557->codec_lock);
 	tas2557_register_codec(pTAS2557);
@@ -839,8 +1369,14 @@ static int tas2557_i2c_probe(struct i2c_client *pClient,
 	pTAS2557->mtimer.function = temperature_timer_func;
 	INIT_WORK(&pTAS2557->mtimerwork, timer_work_routine);
 
+	nResult = sysfs_create_group(&pClient->dev.kobj, &tas2557_attribute_group);
+	if (nResult < 0)
+		dev_err(pTAS2557->dev, "sysfs create failed, %d\n", nResult);
+
 	nResult = request_firmware_nowait(THIS_MODULE, 1, pFWName,
 		pTAS2557->dev, GFP_KERNEL, pTAS2557, tas2557_fw_ready);
+	if (nResult < 0)
+		tas2557_pm_put(pTAS2557);
 
 err:
 
@@ -853,17 +1389,42 @@ static int tas2557_i2c_remove(struct i2c_client *pClient)
 
 	dev_info(pTAS2557->dev, "%s\n", __func__);
 
+	sysfs_remove_group(&pClient->dev.kobj, &tas2557_attribute_group);
+
+	/* no new requests from the card or the misc node past this point */
 #ifdef CONFIG_TAS2557_CODEC
 	tas2557_deregister_codec(pTAS2557);
-	mutex_destroy(&pTAS2557->codec_lock);
 #endif
-
 #ifdef CONFIG_TAS2557_MISC
 	tas2557_deregister_misc(pTAS2557);
+#endif
+
+	if (gpio_is_valid(pTAS2557->mnGpioINT)) {
+		free_irq(pTAS2557->mnIRQ, pTAS2557);
+		cancel_delayed_work_sync(&pTAS2557->irq_work);
+	}
+	hrtimer_cancel(&pTAS2557->mtimer);
+	cancel_work_sync(&pTAS2557->mtimerwork);
+	/* drains the engine, then drop a recovery a failed download queued */
+	tas2557_engine_exit(pTAS2557);
+	if (gpio_is_valid(pTAS2557->mnGpioINT))
+		cancel_delayed_work_sync(&pTAS2557->irq_work);
+
+	pm_runtime_disable(pTAS2557->dev);
+	pm_runtime_dont_use_autosuspend(pTAS2557->dev);
+	tas2557_shadow_free(pTAS2557);
+	tas2557_prefetch_free(pTAS2557);
+	tas2557_calibration_free(pTAS2557);
+
+#ifdef CONFIG_TAS2557_CODEC
+	mutex_destroy(&pTAS2557->codec_lock);
+#endif
+#ifdef CONFIG_TAS2557_MISC
 	mutex_destroy(&pTAS2557->file_lock);
 #endif
 
 	mutex_destroy(&pTAS2557->dev_lock);
+	mutex_destroy(&pTAS2557->fault_lock);
 	return 0;
 }
 
@@ -887,6 +1448,7 @@ static struct i2c_driver tas2557_i2c_driver = {
 	.driver = {
 			.name = "tas2557",
 			.owner = THIS_MODULE,
+			.pm = &tas2557_pm_ops,
 #if defined(CONFIG_OF)
 			.of_match_table = of_match_ptr(tas2557_of_match),
 #endif
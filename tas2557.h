@@ -22,6 +22,7 @@
 #ifndef _TAS2557_H
 #define _TAS2557_H
 
+#include <linux/i2c.h>
 #include <linux/regmap.h>
 #include <linux/workqueue.h>
 #include <linux/timer.h>
@@ -84,6 +85,11 @@
 #define TAS2557_CLK_ERR_CTRL3			TAS2557_REG(0, 0, 46)	/* B0_P0_R0x2e*/
 #define TAS2557_DBOOST_CFG_REG			TAS2557_REG(0, 0, 52)
 #define TAS2557_POWER_UP_FLAG_REG		TAS2557_REG(0, 0, 100)
+/*
+* the bits the IRQ handler has always required set before it
+* treats Class-D as powered, the power sequences poll the same
+*/
+#define TAS2557_POWER_UP_FLAG_MASK		0xc0
 #define TAS2557_FLAGS_1				TAS2557_REG(0, 0, 104)	/* B0_P0_R0x68*/
 #define TAS2557_FLAGS_2				TAS2557_REG(0, 0, 108)	/* B0_P0_R0x6c*/
 
@@ -289,6 +295,7 @@
 #define TAS2557_DSP_CLK_FROM_PLL		(0x1 << 5)
 
 #define TAS2557_FW_NAME     "tas2557_uCDSP.bin"
+#define TAS2557_CAL_NAME    "tas2557_cal.bin"
 #define TAS2557_PG1P0_FW_NAME     "tas2557_pg1p0_uCDSP.bin"
 
 #define	TAS2557_APP_ROM1MODE	0
@@ -319,6 +326,28 @@
 #define	ERROR_CLASSD_PWR	0x00002000
 #define	ERROR_SAFE_GUARD	0x00004000
 #define	ERROR_FAILSAFE		0x40000000
+/* the bits decoded from FLAGS_1/FLAGS_2 */
+#define	TAS2557_ERROR_FLAGS	(ERROR_CLK_DET2 | ERROR_CLK_DET1 | ERROR_CLK_LOST \
+	| ERROR_BROWNOUT | ERROR_DIE_OVERTEMP | ERROR_CLK_HALT \
+	| ERROR_UNDER_VOLTAGE | ERROR_OVER_CURRENT)
+
+/* read back verification of downloaded blocks */
+#define	TAS2557_VERIFY_FULL		0
+#define	TAS2557_VERIFY_SAMPLED	1
+#define	TAS2557_VERIFY_CRC_ONLY	2
+#define	TAS2557_VERIFY_OFF		3
+#define	TAS2557_VERIFY_MODES	4
+
+#define	TAS2557_VERIFY_SAMPLE_PCT	10
+
+struct TVerifyStats {
+	unsigned int mnBlocks;
+	unsigned int mnBursts;
+	unsigned int mnBytesRead;
+	unsigned int mnYRAMErrors;
+	unsigned int mnPRAMErrors;
+	unsigned int mnEscalations;
+};
 
 struct TBlock {
 	unsigned int mnType;
@@ -330,11 +359,33 @@ struct TBlock {
 	unsigned char *mpData;
 };
 
+/*
+* coefficient word of a CFG_COEFF_DEV_A burst, mnReg is TAS2557_REG() + 1
+* so that an empty slot reads 0
+*/
+struct TCoeffEntry {
+	unsigned int mnReg;
+	unsigned int mnBlock;
+	unsigned int mnOffset;
+};
+
 struct TData {
 	char mpName[64];
 	char *mpDescription;
 	unsigned int mnBlocks;
 	struct TBlock *mpBlocks;
+	/* open addressing, mnCoeffSlots is a power of 2 */
+	unsigned int mnCoeffSlots;
+	struct TCoeffEntry *mpCoeffIndex;
+};
+
+/*
+* register values written by firmware blocks,
+* (TAS2557_REG << 8) | value, sorted by register
+*/
+struct TRegImage {
+	unsigned int mnRegs;
+	unsigned int *mpEntries;
 };
 
 struct TProgram {
@@ -343,12 +394,18 @@ struct TProgram {
 	unsigned char mnAppMode;
 	unsigned short mnBoost;
 	struct TData mData;
+	/* program blocks can't be replayed as a register diff */
+	bool mbResetOnly;
+	struct TRegImage mImage;
 };
 
 struct TPLL {
 	char mpName[64];
 	char *mpDescription;
 	struct TBlock mBlock;
+	/* content hash, and the first PLL with identical content */
+	unsigned int mnHash;
+	unsigned int mnCanonical;
 };
 
 struct TConfiguration {
@@ -360,7 +417,12 @@ struct TConfiguration {
 	unsigned int mnSamplingRate;
 	unsigned char mnPLLSrc;
 	unsigned int mnPLLSrcRate;
+	/* coefficient blocks end in their only swap, so they can be staged in the inactive bank */
+	bool mbSwapStage;
 	struct TData mData;
+	/* registers the configuration writes, values unused, valid if mbRegsTracked */
+	bool mbRegsTracked;
+	struct TRegImage mRegs;
 };
 
 struct TCalibration {
@@ -386,12 +448,150 @@ struct TFirmware {
 	struct TPLL *mpPLLs;
 	unsigned int mnPrograms;
 	struct TProgram *mpPrograms;
+	/* mnPrograms x mnPrograms, [from * mnPrograms + to] */
+	unsigned char *mpProgramSwitch;
 	unsigned int mnConfigurations;
 	struct TConfiguration *mpConfigurations;
 	unsigned int mnCalibrations;
 	struct TCalibration *mpCalibrations;
 };
 
+/*
+* register values written since the last reset, one entry per page;
+* mpBank[] keeps the last value written between swaps of either parity,
+* a byte equal in both holds whichever coefficient bank is writable
+*/
+struct TShadowPage {
+	unsigned char mnBook;
+	unsigned char mnPage;
+	unsigned char mpValid[16];
+	unsigned char mpValue[128];
+	unsigned char mpBankValid[2][16];
+	unsigned char mpBank[2][128];
+};
+
+struct TShadow {
+	unsigned int mnPages;
+	unsigned int mnCapacity;
+	unsigned int mnLast;
+	/* an allocation failed, the shadow can't be replayed */
+	bool mbLost;
+	/* parity of the coefficient swaps written since reset */
+	unsigned int mnBank;
+	struct TShadowPage *mpPages;
+};
+
+/*
+* rate switch cost model: 9 SCL clocks per byte at 400 kHz, a write
+* carries the device address and register ahead of its data
+*/
+#define	TAS2557_COST_BYTE_NS		22500
+#define	TAS2557_COST_WRITE_HDR		2
+
+/* reset waits, shared by the reset paths and the cost model, in us */
+#define	TAS2557_RESET_PULSE_US		5000
+#define	TAS2557_RESET_SETTLE_US		2000
+#define	TAS2557_SW_RESET_US		1000
+
+#define	TAS2557_RATE_NONE			0
+#define	TAS2557_RATE_CURRENT		1
+#define	TAS2557_RATE_SAME_PLL		2
+#define	TAS2557_RATE_SAME_PROGRAM	3
+#define	TAS2557_RATE_PROGRAM		4
+
+struct TRatePlan {
+	unsigned int mnKind;
+	int mnProgram;
+	int mnConfiguration;
+	unsigned int mnCostUs;
+};
+
+/* firmware data read by tas2557_get_fw_coefficient() */
+#define	TAS2557_FW_DATA_PROGRAM		0
+#define	TAS2557_FW_DATA_CONFIGURATION	1
+#define	TAS2557_FW_DATA_CALIBRATION	2
+
+/* matching bytes merged into a delta write rather than starting a new burst */
+#define TAS2557_DELTA_GAP		4
+
+/* registers read back on resume to tell whether power was lost */
+#define TAS2557_SNAPSHOT_SENTINELS	4
+
+struct TSentinel {
+	unsigned int mnReg;
+	unsigned char mnValue;
+};
+
+/* a block's bursts sent as one multi-message I2C transfer */
+#define TAS2557_BATCH_MSGS		24
+#define TAS2557_BATCH_BYTES		1024
+
+/*
+* each message is [register, data...]; a batch opens with its own book
+* and page select, so a failed transfer can be sent again as a whole
+*/
+struct TWriteBatch {
+	struct i2c_msg mpMsgs[TAS2557_BATCH_MSGS];
+	unsigned char mpBuf[TAS2557_BATCH_BYTES];
+	unsigned int mnMsgs;
+	unsigned int mnBytes;
+	unsigned char mnBook;
+	unsigned char mnPage;
+	/* first failed transfer since the last batch_flush */
+	int mnError;
+};
+
+/* transitions seen before the next configuration is staged */
+#define	TAS2557_PREFETCH_MIN_COUNT	2
+
+struct TPrefetchStats {
+	unsigned int mnStaged;
+	unsigned int mnHits;
+	unsigned int mnMisses;
+};
+
+#define	TAS2557_SWITCH_RESET		0
+#define	TAS2557_SWITCH_INCREMENTAL	1
+
+/* program/configuration request waiting for codec_lock */
+#define	TAS2557_LOAD_UNCHANGED		(-1)
+#define	TAS2557_LOAD_KEEP_CONFIG	(-2)
+
+/*
+* complete target state for tas2557_set_profile(), also the layout of the
+* "Profile" bytes control and SMARTPA_SPK_SET_PROFILE
+*/
+#define	TAS2557_PROFILE_UNCHANGED	(-1)
+
+struct TProfile {
+	int mnProgram;
+	int mnConfiguration;
+	int mnCalibration;
+	int mnSamplingRate;
+	int mnBitRate;
+};
+
+/*
+* factory calibration run for tas2557_run_calibration() and
+* SMARTPA_SPK_CALIBRATE, R0 and T are returned as read from the device
+*/
+#define	TAS2557_CALIBRATION_MAX_MS	10000
+
+struct TCalibrationRun {
+	int mnProgram;
+	int mnConfiguration;
+	unsigned int mnDurationMs;
+	int mnR0;
+	int mnT;
+};
+
+struct TLoadRequest {
+	bool mbPending;
+	unsigned int mnSeq;
+	int mnProgram;
+	int mnConfiguration;
+};
+
 struct tas2557_register {
 	int book;
 	int page;
@@ -404,6 +604,12 @@ struct tas2557_priv {
 	int mnPGID;
 	int mnResetGPIO;
 	struct mutex dev_lock;
+	/*
+	* the IRQ thread's fault shutdown against firmware block and
+	* register sequence loads, and mbIRQFault; taken inside codec_lock
+	* and file_lock, outside dev_lock
+	*/
+	struct mutex fault_lock;
 	struct TFirmware *mpFirmware;
 	struct TFirmware *mpCalFirmware;
 	unsigned int mnCurrentProgram;
@@ -414,7 +620,13 @@ struct tas2557_priv {
 	unsigned char mnCurrentBook;
 	unsigned char mnCurrentPage;
 	bool mbTILoadActive;
+	/* a failed batch may have left the page register anywhere */
+	bool mbPageLost;
 	bool mbPowerUp;
+	/* stream mute, kept across power cycles, only stream power ups follow it */
+	bool mbMute;
+	/* mute applied by the last power up or stream mute */
+	bool mbMuted;
 	bool mbLoadConfigurationPrePowerUp;
 	bool mbLoadCalibrationPostPowerUp;
 	bool mbCalibrationLoaded;
@@ -436,6 +648,12 @@ struct tas2557_priv {
 		unsigned int reg,
 		unsigned int mask,
 		unsigned int value);
+	/* queue a burst, it goes out at batch_flush or the next access */
+	int (*batch_write)(struct tas2557_priv *pTAS2557,
+		unsigned int reg,
+		unsigned char *pData,
+		unsigned int len);
+	int (*batch_flush)(struct tas2557_priv *pTAS2557);
 	int (*set_config)(struct tas2557_priv *pTAS2557,
 		int config);
 	int (*set_calibration)(struct tas2557_priv *pTAS2557,
@@ -451,6 +669,8 @@ struct tas2557_priv {
 	struct delayed_work irq_work;
 	unsigned int mnIRQ;
 	bool mbIRQEnable;
+	/* critical fault seen by the IRQ thread, irq_work reloads; fault_lock */
+	bool mbIRQFault;
 	unsigned char mnI2SBits;
 
 
@@ -472,6 +692,94 @@ struct tas2557_priv {
 	*/
 	bool mbBypassTMax;
 
+	/* issue YRAM coefficient writes while a firmware delay runs */
+	bool mbDelayHoist;
+
+	/* calibration file for Calibration 0xFF and its cached image */
+	char mpCalName[64];
+	unsigned char *mpCalImage;
+	unsigned int mnCalImageSize;
+
+	/* coefficient bytes the shadow shows in place are not written again */
+	bool mbDeltaWrite;
+	unsigned int mnDeltaWritten;
+	unsigned int mnDeltaSkipped;
+
+	/* block verification policy, escalated to full after any failure */
+	unsigned int mnVerifyPolicy;
+	unsigned int mnVerifySamplePct;
+	bool mbVerifyEscalated;
+	struct TVerifyStats mVerifyStats[TAS2557_VERIFY_MODES];
+
+	/* a newer request cancels the load in flight at its next stage */
+	spinlock_t mLoadLock;
+	struct TLoadRequest mLoadRequest;
+	unsigned int mnLoadSeq;
+	bool mbResetRequired;
+
+	/* background download engine, requests are posted under mLoadLock */
+	struct workqueue_struct *mpEngineWQ;
+	struct work_struct mEngineWork;
+	unsigned int mnEngineRate;
+	bool mbEnginePowerPending;
+	bool mbEnginePowerOn;
+
+	/* configuration selected while powered down, loaded ahead of power up */
+	struct work_struct mPreloadWork;
+
+	/* CFG_POST and CFG_POST_POWER blocks, run on the engine after unmute */
+	struct work_struct mPostWork;
+	int mnPostConfiguration;
+	bool mbPostPowerPending;
+
+	/*
+	* warm standby: Class-D and boost off, PLL, DSP and coefficients kept
+	* until runtime PM autosuspends the device
+	*/
+	bool mbStandby;
+	unsigned int mnStandbyTimeoutMs;
+
+	/* runtime PM reference held while the amplifier is powered up */
+	bool mbPowerRef;
+
+	/*
+	* configuration transition counts, the likely next configuration is
+	* written to the inactive bank with its swap held until requested
+	*/
+	bool mbPrefetch;
+	unsigned int mnPrefetchConfigs;
+	unsigned short *mpPrefetchHistory;
+	int mnStagedConfiguration;
+	struct TPrefetchStats mPrefetchStats;
+	struct work_struct mPrefetchWork;
+
+	/* written state, sampled on resume to tell whether power was lost */
+	struct TShadow mShadow;
+	struct TSentinel mSentinels[TAS2557_SNAPSHOT_SENTINELS];
+	unsigned int mnSentinels;
+
+	/*
+	* bursts of the block being loaded, dev_lock; mbBatchOpen is set by
+	* tas2557_load_block() under fault_lock when the adapter takes
+	* multi-message transfers
+	*/
+	struct TWriteBatch mBatch;
+	bool mbBatchCapable;
+	bool mbBatchOpen;
+
+	/*
+	* live coefficient update: blocks fill the inactive bank and the
+	* last coefficient swap command is held back until the outermost
+	* of mnSwapDepth nested updates commits; mnSwapLevel is the depth
+	* that holds it
+	*/
+	unsigned int mnSwapDepth;
+	unsigned int mnSwapLevel;
+	bool mbSwapPending;
+	unsigned char mnSwapReg;
+	unsigned char mnSwapLen;
+	unsigned char mpSwapData[5];
+
 #ifdef CONFIG_TAS2557_CODEC
 	struct mutex codec_lock;
 #endif
@@ -479,6 +787,12 @@ struct tas2557_priv {
 #ifdef CONFIG_TAS2557_MISC
 	int mnDBGCmd;
 	int mnCurrentReg;
+	/* TIAUDIO_CMD_RATE_COST reply, planned by the write */
+	unsigned char mpRatePlan[8];
+	int mnRatePlanResult;
+	unsigned int mnCoeffQueryData;
+	unsigned int mnCoeffQueryIndex;
+	int mnCoeffQueryReg;
 	struct mutex file_lock;
 #endif
 